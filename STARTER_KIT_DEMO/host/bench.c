@@ -0,0 +1,238 @@
+/*
+ * Host benchmark
+ *
+ * Runs the kernel under the host port and times its hot paths: the SVC
+ * round trip, one the dispatcher refuses, a menu redraw as single
+ * syscalls and as a batch, a temperature read in the SVC and through the
+ * device thread, a yield, a semaphore handoff between two
+ * threads, creating and joining a thread, the release latency of a
+ * periodic thread, and a yield and an event round trip between
+ * protothreads. Then it sleeps for
+ * a second and reports the idle hook runs and the cpu load, and the
+ * syscall counts when built with -DSOS_SYSCALL_STATS.
+ * Numbers are in cycles of the emulated 120 MHz core, which the host
+ * clock drives, so they compare builds on the same machine rather than
+ * predict the board.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include <stdlib.h>
+#include "minios.h"
+#include "sysnums.h"
+#include "threads.h"
+#include "sync.h"
+#include "scheduler.h"
+#include "port.h"
+#include "proto.h"
+#include "batch.h"
+#include "device.h"
+
+#define BENCH_ROUNDS		200000
+#define BENCH_SPAWNS		2000
+#define BENCH_JOBS			500
+#define BENCH_PERIOD_US		1000
+
+static Semaphore ping = SEMAPHORE_INIT(0);
+static Semaphore pong = SEMAPHORE_INIT(0);
+static Semaphore done = SEMAPHORE_INIT(0);
+static ThreadStats periodicStats;
+static int protoRounds;
+static volatile uint32_t idleHookRuns;
+
+static void report(const char* what, uint32_t cycles, uint32_t rounds){
+	uint64_t tenths = (uint64_t) cycles * 10 / rounds;
+
+	printf("%-22s %6lu.%lu cycles\n", what, (unsigned long) (tenths / 10), (unsigned long) (tenths % 10));
+}
+
+static void thread_pong(void){
+	for (int i = 0; i < BENCH_ROUNDS; i++){
+		semWait(&ping, WAIT_FOREVER);
+		semPost(&pong);
+	}
+}
+
+static void thread_spawned(void){
+}
+
+static void thread_periodic(void){
+	periodicStart(BENCH_PERIOD_US, 0, 0);
+	for (int i = 0; i < BENCH_JOBS; i++)
+		periodicWait();
+
+	//before it exits, which ends its periodic accounting
+	threadStats(threadSelf(), &periodicStats);
+	semPost(&done);
+}
+
+static int proto_yield(ProtoTask* pt){
+	PT_BEGIN(pt);
+	for (protoRounds = 0; protoRounds < BENCH_ROUNDS; protoRounds++)
+		PT_YIELD(pt);
+	semPost(&done);
+	PT_END(pt);
+}
+
+static int proto_ping(ProtoTask* pt){
+	PT_BEGIN(pt);
+	for (protoRounds = 0; protoRounds < BENCH_ROUNDS; protoRounds++){
+		protoSignal(0x01);
+		PT_WAIT_EVENT(pt, 0x02);
+	}
+	semPost(&done);
+	PT_END(pt);
+}
+
+static int proto_pong(ProtoTask* pt){
+	PT_BEGIN(pt);
+	while (1){
+		PT_WAIT_EVENT(pt, 0x01);
+		protoSignal(0x02);
+	}
+	PT_END(pt);
+}
+
+static bool bench_idle_hook(void){
+	idleHookRuns++;
+	return false;
+}
+
+static ProtoTask yieldTask = PROTO_TASK_INIT(&proto_yield, "yield");
+static ProtoTask pingTask = PROTO_TASK_INIT(&proto_ping, "ping");
+static ProtoTask pongTask = PROTO_TASK_INIT(&proto_pong, "pong");
+
+/*
+ * The static thread of include/conf_threads.h. Privileged, so it can create
+ * threads without a syscall; everything else goes through the user calls.
+ */
+void thread_bench(void){
+	ThreadStats stats;
+	uint32_t start;
+	int i, tid;
+
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		svc_r0_r1(SYSCALL_THREADSTATS, 1000, &stats);
+	report("syscall", cpu_cycles_since(start), BENCH_ROUNDS);
+
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		svc(NUM_OF_SYSCALLS);
+	report("refused syscall", cpu_cycles_since(start), BENCH_ROUNDS);
+
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++){
+		svc(SYSCALL_LED1_ON);
+		svc(SYSCALL_LED2_OFF);
+		svc(SYSCALL_LED3_OFF);
+		svc(SYSCALL_CLEARSCREEN);
+		svc_r0_r1(SYSCALL_WRITESTRINGTOSCREEN, "Built in Apps", 0);
+		svc_r0_r1(SYSCALL_WRITESTRINGTOSCREEN, "Choose a built in app", 1);
+		svc_r0_r1(SYSCALL_WRITESTRINGTOSCREEN, "________________", 2);
+		svc_r0_r1(SYSCALL_WRITESTRINGTOSCREEN, " <-  Launch  ->", 3);
+	}
+	report("menu redraw, 8 calls", cpu_cycles_since(start), BENCH_ROUNDS);
+
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++){
+		BatchOp ops[] = {
+			BATCH_OP_LED(1, true),
+			BATCH_OP_LED(2, false),
+			BATCH_OP_LED(3, false),
+			BATCH_OP_CLEAR(),
+			BATCH_OP_TEXT("Built in Apps", 0, 0),
+			BATCH_OP_TEXT("Choose a built in app", 1, 0),
+			BATCH_OP_TEXT("________________", 2, 0),
+			BATCH_OP_TEXT(" <-  Launch  ->", 3, 0),
+		};
+
+		batch(ops, 8);
+	}
+	report("menu redraw, batched", cpu_cycles_since(start), BENCH_ROUNDS);
+
+	double temperature;
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		svc_r0(SYSCALL_GETTEMP, &temperature);
+	report("temperature, in svc", cpu_cycles_since(start), BENCH_ROUNDS);
+
+	static EventFlags read = EVENT_FLAGS_INIT;
+	BatchOp readOp = BATCH_OP_GETTEMP(&temperature);
+	DeviceRequest request = DEVICE_REQUEST_INIT(&readOp, 1, &read, 1, NULL);
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++){
+		deviceSubmit(&request);
+		if (deviceWait(&request) != 0)
+			printf("device request failed\n");
+	}
+	report("temperature, device", cpu_cycles_since(start), BENCH_ROUNDS);
+
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		svc(SYSCALL_YIELD);
+	report("yield", cpu_cycles_since(start), BENCH_ROUNDS);
+
+	tid = createThreadEx(&thread_pong, "pong", 128, PRIORITY_NORMAL, 1);
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++){
+		semPost(&ping);
+		semWait(&pong, WAIT_FOREVER);
+	}
+	report("semaphore round trip", cpu_cycles_since(start), BENCH_ROUNDS);
+	joinThread(tid);
+
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_SPAWNS; i++)
+		joinThread(createThreadEx(&thread_spawned, "spawned", 64, PRIORITY_NORMAL, 1));
+	report("create and join", cpu_cycles_since(start), BENCH_SPAWNS);
+
+	tid = createThreadEx(&thread_periodic, "periodic", 128, PRIORITY_NORMAL, 1);
+	semWait(&done, WAIT_FOREVER);
+	printf("%-22s %8lu cycles max, %lu of %lu deadlines missed\n", "periodic release",
+		(unsigned long) periodicStats.maxLatencyCycles, (unsigned long) periodicStats.deadlineMisses,
+		(unsigned long) periodicStats.jobs);
+	joinThread(tid);
+
+	start = cpu_cycle_counter_read();
+	protoStart(&yieldTask);
+	semWait(&done, WAIT_FOREVER);
+	report("protothread yield", cpu_cycles_since(start), BENCH_ROUNDS);
+
+	protoStart(&pongTask);
+	start = cpu_cycle_counter_read();
+	protoStart(&pingTask);
+	semWait(&done, WAIT_FOREVER);
+	report("protothread event", cpu_cycles_since(start), BENCH_ROUNDS);
+
+	//a second asleep, for the idle hook to run and a load window to end
+	idleHook(&bench_idle_hook);
+	svc_r0(SYSCALL_DELAY, 1100);
+	printf("%-22s %8lu runs, cpu load %d.%d%%\n", "idle hook", (unsigned long) idleHookRuns, cpuLoad() / 10, cpuLoad() % 10);
+
+#ifdef SOS_SYSCALL_STATS
+	SyscallStats calls;
+	int found;
+
+	printf("\nsvc    calls      avg      min      max\n");
+	for (i = 0; (found = syscallStats(i, &calls)) >= 0; i++){
+		if (found == 0)
+			printf("%3d %8lu %8lu %8lu %8lu\n", i, (unsigned long) calls.count,
+				(unsigned long) (calls.totalCycles / calls.count), (unsigned long) calls.minCycles,
+				(unsigned long) calls.maxCycles);
+	}
+#endif
+
+	fflush(stdout);
+	exit(0);
+}
+
+int main(void){
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	startScheduler();
+	hostStart();
+	return 0;
+}
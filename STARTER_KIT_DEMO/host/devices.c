@@ -0,0 +1,123 @@
+/*
+ * Host devices
+ *
+ * In-memory stand-ins for the board drivers the kernel and syscalls.c call:
+ * a text framebuffer for the OLED, the LEDs, a fixed temperature, an ADC
+ * that completes at once and a CDC that writes to stdout.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include <unistd.h>
+#include "conf_usb.h"
+#include "data.h"
+#include "devices.h"
+
+//Font of the OLED driver is 6 pixels wide on a 128x32 display
+#define SCREEN_COLUMN_PIXELS	6
+
+RING_DEFINE(light_samples, uint16_t, 4);
+MPSC_RING_DEFINE(button_events, uint8_t, 8);
+
+Adc hostAdc;
+bool hostLeds[HOST_LEDS];
+char hostScreen[HOST_SCREEN_ROWS][HOST_SCREEN_COLUMNS + 1];
+
+static uint8_t screenRow;
+static uint8_t screenColumn;
+static uint16_t lightLevel;
+
+void ssd1306_clear(void){
+	memset(hostScreen, ' ', sizeof(hostScreen));
+	for (int i = 0; i < HOST_SCREEN_ROWS; i++)
+		hostScreen[i][HOST_SCREEN_COLUMNS] = '\0';
+	screenRow = 0;
+	screenColumn = 0;
+}
+
+void ssd1306_set_page_address(uint8_t address){
+	screenRow = address % HOST_SCREEN_ROWS;
+}
+
+void ssd1306_set_column_address(uint8_t address){
+	screenColumn = address / SCREEN_COLUMN_PIXELS;
+}
+
+void ssd1306_write_text(const char* string){
+	while (*string != '\0' && screenColumn < HOST_SCREEN_COLUMNS)
+		hostScreen[screenRow][screenColumn++] = *string++;
+}
+
+void ioport_set_pin_level(uint32_t pin, bool level){
+	if (pin < HOST_LEDS)
+		hostLeds[pin] = level;
+}
+
+uint8_t at30tse_read_temperature(double* temperature){
+	*temperature = 21.5;
+	return 0;
+}
+
+/*
+ * The conversion completes at once; what the ADC interrupt would send
+ * goes to light_samples from here.
+ */
+void adc_start(Adc* p_adc){
+	UNUSED(p_adc);
+
+	lightLevel = (lightLevel + 97) & 0xFFF;
+	ringSend(&light_samples, &lightLevel);
+}
+
+void udc_start(void){
+}
+
+void udc_attach(void){
+	my_callback_cdc_enable();
+}
+
+void udc_detach(void){
+	my_callback_cdc_disable();
+}
+
+bool udi_cdc_is_tx_ready(void){
+	return true;
+}
+
+int udi_cdc_putc(int value){
+	char c = value;
+
+	return write(STDOUT_FILENO, &c, 1) == 1;
+}
+
+/*
+ * Returns the number of bytes left to send, like the ASF function.
+ */
+size_t udi_cdc_write_buf(const void* buf, size_t size){
+	const char* p = buf;
+	ssize_t n;
+
+	while (size > 0){
+		n = write(STDOUT_FILENO, p, size);
+		if (n <= 0)
+			break;
+		p += n;
+		size -= n;
+	}
+	return size;
+}
+
+size_t udi_cdc_get_free_tx_buffer(void){
+	return 512;
+}
+
+bool udi_cdc_is_rx_ready(void){
+	return false;
+}
+
+int udi_cdc_getc(void){
+	return 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * Host devices
+ *
+ * State of the stand-in board devices, for the host programs to look at.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef HOST_DEVICES_H_
+#define HOST_DEVICES_H_
+
+#include <stdbool.h>
+
+#define HOST_LEDS				4
+#define HOST_SCREEN_ROWS		4
+#define HOST_SCREEN_COLUMNS		21
+
+extern bool hostLeds[HOST_LEDS];
+extern char hostScreen[HOST_SCREEN_ROWS][HOST_SCREEN_COLUMNS + 1];
+
+#endif /* HOST_DEVICES_H_ */
@@ -0,0 +1,229 @@
+/*
+ * Host stand-in for asf.h
+ *
+ * The parts of CMSIS and ASF the kernel uses, emulated for the host port.
+ * Registers the kernel reads or writes are plain structs; the ones that
+ * count (DWT->CYCCNT, RTT->RTT_VR) are refreshed from the monotonic clock
+ * on every access. PRIMASK and IPSR are variables that port_posix.c keeps
+ * consistent with the SIGALRM tick and the emulated SVC and PendSV.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef HOST_ASF_H_
+#define HOST_ASF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define UNUSED(v)			(void) (v)
+#define RAMFUNC
+
+//////////////////////////////////////////////////////////////////////////
+//								Cpu										//
+//////////////////////////////////////////////////////////////////////////
+
+//The emulated core runs at the clock of the board
+#define HOST_CPU_HZ			120000000UL
+#define BOARD_FREQ_SLCK_XTAL	32768UL
+#define __FPU_USED			0
+#define __NVIC_PRIO_BITS	4
+
+extern volatile uint32_t hostPrimask;
+extern volatile uint32_t hostIpsr;
+
+void hostService(void);
+void hostWaitForInterrupt(void);
+
+typedef uint32_t irqflags_t;
+
+static inline uint32_t __get_PRIMASK(void){ return hostPrimask; }
+static inline void __disable_irq(void){ hostPrimask = 1; __atomic_signal_fence(__ATOMIC_SEQ_CST); }
+static inline void __set_PRIMASK(uint32_t m){
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	hostPrimask = m;
+	if (!m)
+		hostService();
+}
+static inline void __enable_irq(void){ __set_PRIMASK(0); }
+
+static inline irqflags_t cpu_irq_save(void){
+	irqflags_t flags = hostPrimask;
+	__disable_irq();
+	return flags;
+}
+static inline void cpu_irq_restore(irqflags_t flags){ __set_PRIMASK(flags); }
+#define cpu_irq_disable()	__disable_irq()
+#define cpu_irq_enable()	__enable_irq()
+
+static inline uint32_t __get_IPSR(void){ return hostIpsr; }
+static inline uint32_t __CLZ(uint32_t x){ return x ? __builtin_clz(x) : 32; }
+#define __DSB()				__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __DMB()				__atomic_thread_fence(__ATOMIC_SEQ_CST)
+//A PendSV pended in thread mode is taken by the next ISB at the latest
+#define __ISB()				hostService()
+#define __WFI()				hostWaitForInterrupt()
+
+//Exclusive monitor. Taking an interrupt or switching threads clears it
+extern volatile uint32_t* hostMonitor;
+extern uint32_t hostMonitorValue;
+
+static inline uint32_t __LDREXW(volatile uint32_t* p){
+	uint32_t v = *p;
+	hostMonitorValue = v;
+	hostMonitor = p;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	return v;
+}
+
+//the compare-exchange also catches a handler that ran between the
+//monitor check and the store
+static inline uint32_t __STREXW(uint32_t v, volatile uint32_t* p){
+	uint32_t seen = hostMonitorValue;
+
+	if (hostMonitor != p)
+		return 1;
+	hostMonitor = NULL;
+	return !__atomic_compare_exchange_n(p, &seen, v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline void __CLREX(void){ hostMonitor = NULL; }
+
+//////////////////////////////////////////////////////////////////////////
+//							System registers							//
+//////////////////////////////////////////////////////////////////////////
+
+typedef struct{
+	volatile uint32_t CTRL;
+	volatile uint32_t LOAD;
+	volatile uint32_t VAL;
+}HostSysTick;
+
+typedef struct{
+	volatile uint32_t ICSR;
+	volatile uint32_t SHCSR;
+	volatile uint32_t CFSR;
+}HostScb;
+
+typedef struct{
+	volatile uint32_t CTRL;
+	volatile uint32_t CYCCNT;
+}HostDwt;
+
+extern HostSysTick hostSysTick;
+extern HostScb hostScb;
+HostDwt* hostDwt(void);
+
+#define SysTick				(&hostSysTick)
+#define SCB					(&hostScb)
+#define DWT					(hostDwt())
+
+#define SysTick_CTRL_ENABLE_Msk		(1UL << 0)
+#define SCB_ICSR_PENDSVSET_Msk		(1UL << 28)
+
+typedef enum{
+	PendSV_IRQn = -2,
+	SysTick_IRQn = -1,
+	RTT_IRQn = 3,
+	ADC_IRQn = 29,
+}IRQn_Type;
+
+uint32_t SysTick_Config(uint32_t ticks);
+void NVIC_SetPendingIRQ(IRQn_Type irq);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+static inline void NVIC_EnableIRQ(IRQn_Type irq){ UNUSED(irq); }
+static inline void NVIC_DisableIRQ(IRQn_Type irq){ UNUSED(irq); }
+static inline void NVIC_SetPriority(IRQn_Type irq, uint32_t p){ UNUSED(irq); UNUSED(p); }
+
+//////////////////////////////////////////////////////////////////////////
+//						Clocks, delays and sleep						//
+//////////////////////////////////////////////////////////////////////////
+
+static inline uint32_t sysclk_get_cpu_hz(void){ return HOST_CPU_HZ; }
+
+static inline void cpu_cycle_counter_init(void){ }
+static inline uint32_t cpu_cycle_counter_read(void){ return DWT->CYCCNT; }
+static inline uint32_t cpu_cycles_since(uint32_t start){ return DWT->CYCCNT - start; }
+
+void delay_us(uint32_t us);
+#define delay_ms(ms)		delay_us((ms) * 1000UL)
+#define delay_s(s)			delay_us((s) * 1000000UL)
+
+enum sleepmgr_mode{
+	SLEEPMGR_ACTIVE = 0,
+	SLEEPMGR_SLEEP_WFE,
+	SLEEPMGR_SLEEP_WFI,
+	SLEEPMGR_WAIT_FAST,
+	SLEEPMGR_WAIT,
+	SLEEPMGR_BACKUP,
+};
+
+static inline enum sleepmgr_mode sleepmgr_get_sleep_mode(void){ return SLEEPMGR_SLEEP_WFI; }
+void sleepmgr_sleep(enum sleepmgr_mode mode);
+
+#define PMC_FSMR_RTTAL		(1UL << 16)
+static inline void pmc_set_fast_startup_input(uint32_t inputs){ UNUSED(inputs); }
+
+//////////////////////////////////////////////////////////////////////////
+//									RTT									//
+//////////////////////////////////////////////////////////////////////////
+
+typedef struct{
+	volatile uint32_t RTT_MR;
+	volatile uint32_t RTT_AR;
+	volatile uint32_t RTT_VR;
+	volatile uint32_t RTT_SR;
+}Rtt;
+
+Rtt* hostRtt(void);
+#define RTT					(hostRtt())
+
+#define RTT_MR_ALMIEN		(1UL << 16)
+#define RTT_MR_RTTINCIEN	(1UL << 17)
+#define RTT_SR_ALMS			(1UL << 0)
+#define RTT_SR_RTTINC		(1UL << 1)
+
+uint32_t rtt_init(Rtt* p_rtt, uint16_t us_prescaler);
+static inline void rtt_sel_source(Rtt* p_rtt, bool is_rtc_sel){ UNUSED(p_rtt); UNUSED(is_rtc_sel); }
+static inline void rtt_enable_interrupt(Rtt* p_rtt, uint32_t sources){ p_rtt->RTT_MR |= sources; }
+static inline void rtt_disable_interrupt(Rtt* p_rtt, uint32_t sources){ p_rtt->RTT_MR &= ~sources; }
+static inline uint32_t rtt_read_timer_value(Rtt* p_rtt){ return p_rtt->RTT_VR; }
+uint32_t rtt_get_status(Rtt* p_rtt);
+uint32_t rtt_write_alarm_time(Rtt* p_rtt, uint32_t alarm);
+
+//////////////////////////////////////////////////////////////////////////
+//							Board devices								//
+//////////////////////////////////////////////////////////////////////////
+
+//In-memory stand-ins, see devices.c
+typedef struct{ int unused; }Adc;
+extern Adc hostAdc;
+#define ADC					(&hostAdc)
+void adc_start(Adc* p_adc);
+
+#define IO1_LED1_PIN		1
+#define IO1_LED2_PIN		2
+#define IO1_LED3_PIN		3
+void ioport_set_pin_level(uint32_t pin, bool level);
+
+void ssd1306_clear(void);
+void ssd1306_set_page_address(uint8_t address);
+void ssd1306_set_column_address(uint8_t address);
+void ssd1306_write_text(const char* string);
+
+uint8_t at30tse_read_temperature(double* temperature);
+
+void udc_start(void);
+void udc_attach(void);
+void udc_detach(void);
+bool udi_cdc_is_tx_ready(void);
+int udi_cdc_putc(int value);
+size_t udi_cdc_write_buf(const void* buf, size_t size);
+size_t udi_cdc_get_free_tx_buffer(void);
+bool udi_cdc_is_rx_ready(void);
+int udi_cdc_getc(void);
+
+#endif /* HOST_ASF_H_ */
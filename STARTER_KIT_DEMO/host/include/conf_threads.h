@@ -0,0 +1,22 @@
+/*
+ * Static threads of the host benchmark
+ *
+ * THREAD(id, entry, name, stack words, priority, slice in ms, privileged),
+ * as in src/config/conf_threads.h.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef CONF_THREADS_H_
+#define CONF_THREADS_H_
+
+#include "minios.h"
+
+void thread_bench(void);
+
+//Privileged, so it can create threads without a syscall
+#define STATIC_THREADS(THREAD) \
+	THREAD(bench,	thread_bench,	"bench",	256,	PRIORITY_NORMAL,	1,	true)
+
+#endif /* CONF_THREADS_H_ */
@@ -0,0 +1,23 @@
+/*
+ * Host stand-in for conf_usb.h
+ *
+ * Only the callbacks syscalls.c implements; the stand-in USB stack in
+ * devices.c calls them.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef HOST_CONF_USB_H_
+#define HOST_CONF_USB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UDC_VBUS_EVENT(b_vbus_high)	user_callback_vbus_action(b_vbus_high)
+extern void user_callback_vbus_action(bool b_vbus_high);
+extern bool my_callback_cdc_enable(void);
+extern void my_callback_cdc_disable(void);
+extern void my_callback_rx_notify(uint8_t port);
+
+#endif /* HOST_CONF_USB_H_ */
@@ -0,0 +1,408 @@
+/*
+ * POSIX host port
+ *
+ * Runs the kernel as a Linux process. Each thread gets a ucontext on a host
+ * stack of its own, the stacks from the kernel pool are only bookkeeping.
+ * A SIGALRM interval timer is the SysTick; the RTT alarm is checked at
+ * every tick. SVCs are function calls that build the frame the hardware
+ * would stack, and PendSV is a swapcontext around switchContext.
+ *
+ * PRIMASK and IPSR are variables. An interrupt that comes while PRIMASK is
+ * set, or while a handler runs, is left pending and taken as soon as both
+ * are clear again, which is when a pending PendSV runs too. The kernel code
+ * between cpu_irq_save and cpu_irq_restore thus never gets interrupted,
+ * same as on the board.
+ *
+ * The kernel keeps pointers in 32-bit words (SVC frames, thread frames),
+ * so everything it points at has to live in the low 4 GB: the build is not
+ * position independent, and the thread stacks are mapped with MAP_32BIT.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#define _GNU_SOURCE
+#include <asf.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "threads.h"
+#include "port.h"
+
+//Host stack of every thread, libc needs a lot more than the pool gives
+#define HOST_STACK_BYTES		(64 * 1024)
+#define HOST_MAX_THREADS		128
+
+//Size of the stack pool the kernel carves thread stacks from
+#define HOST_STACK2_BYTES		0x8000
+
+//Pending interrupts
+#define HOST_IRQ_SYSTICK		(1UL << 0)
+#define HOST_IRQ_RTT			(1UL << 1)
+
+//Exception numbers, as IPSR shows them
+#define EXCEPTION_SVCALL		11
+#define EXCEPTION_PENDSV		14
+#define EXCEPTION_SYSTICK		15
+#define EXCEPTION_IRQ(n)		(16 + (n))
+
+void SVC_Switch(unsigned int *);
+uint32_t* switchContext(uint32_t*);
+void SysTick_Handler(void);
+void RTT_Handler(void);
+
+extern volatile int currentThreadId;
+
+//The pool, between the same symbols the linker script of the board defines.
+//The kernel declares them as arrays of words
+asm(".section .bss\n"
+	".balign 32\n"
+	".globl _sstack2\n"
+	"_sstack2:\n"
+	".space " "0x8000" "\n"
+	".globl _estack2\n"
+	"_estack2:\n"
+	".previous\n");
+
+volatile uint32_t hostPrimask = 0;
+volatile uint32_t hostIpsr = 0;
+volatile uint32_t* hostMonitor = NULL;
+static volatile bool switchLocked = false;
+uint32_t hostMonitorValue;
+
+HostSysTick hostSysTick;
+HostScb hostScb;
+
+static HostDwt dwt;
+static Rtt rtt;
+static uint64_t rttBase;
+static uint32_t rttPrescaler = 0x8000;
+static uint32_t rttLastValue;
+
+static volatile uint32_t hostPending = 0;
+
+static ucontext_t bootContext;
+static ucontext_t contexts[HOST_MAX_THREADS];
+static void* stacks[HOST_MAX_THREADS];
+static void (*entries[HOST_MAX_THREADS])(void);
+static uint32_t* savedSp[HOST_MAX_THREADS];
+
+static uint64_t hostNanos(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * The cycle counter of a core running at HOST_CPU_HZ.
+ */
+HostDwt* hostDwt(void){
+	dwt.CYCCNT = (uint32_t) (hostNanos() * (HOST_CPU_HZ / 1000000) / 1000);
+	return &dwt;
+}
+
+Rtt* hostRtt(void){
+	rtt.RTT_VR = (uint32_t) ((hostNanos() - rttBase) * BOARD_FREQ_SLCK_XTAL / (rttPrescaler * 1000000000ULL));
+	return &rtt;
+}
+
+uint32_t rtt_init(Rtt* p_rtt, uint16_t us_prescaler){
+	rttBase = hostNanos();
+	rttPrescaler = (us_prescaler != 0) ? us_prescaler : 0x10000;
+	rttLastValue = 0;
+	p_rtt->RTT_MR = 0;
+	p_rtt->RTT_SR = 0;
+	return 0;
+}
+
+uint32_t rtt_get_status(Rtt* p_rtt){
+	uint32_t status = p_rtt->RTT_SR;
+
+	p_rtt->RTT_SR = 0;
+	return status;
+}
+
+uint32_t rtt_write_alarm_time(Rtt* p_rtt, uint32_t alarm){
+	if (alarm == 0)
+		return 1;
+	p_rtt->RTT_AR = alarm - 1;
+	return 0;
+}
+
+void NVIC_SetPendingIRQ(IRQn_Type irq){
+	if (irq == RTT_IRQn)
+		__atomic_or_fetch(&hostPending, HOST_IRQ_RTT, __ATOMIC_SEQ_CST);
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type irq){
+	if (irq == RTT_IRQn)
+		__atomic_and_fetch(&hostPending, ~HOST_IRQ_RTT, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * The RTT alarm goes off when the counter gets to it, like on the board it
+ * only matches once.
+ */
+static void hostRttCheck(void){
+	uint32_t now = hostRtt()->RTT_VR;
+	uint32_t alarm = rtt.RTT_AR + 1;
+
+	if ((int32_t) (now - alarm) >= 0 && (int32_t) (rttLastValue - alarm) < 0){
+		rtt.RTT_SR |= RTT_SR_ALMS;
+		if (rtt.RTT_MR & RTT_MR_ALMIEN)
+			__atomic_or_fetch(&hostPending, HOST_IRQ_RTT, __ATOMIC_SEQ_CST);
+	}
+	rttLastValue = now;
+}
+
+/*
+ * PendSV: lets the kernel pick the next thread and switches to it. Returns
+ * in the thread that was switched away from, whenever it runs again.
+ */
+static void hostPendSV(void){
+	int old = currentThreadId;
+	int next;
+
+	hostIpsr = EXCEPTION_PENDSV;
+	hostPrimask = 1;
+	hostScb.ICSR &= ~SCB_ICSR_PENDSVSET_Msk;
+	hostMonitor = NULL;
+
+	uint32_t* sp = switchContext(old >= 0 ? savedSp[old] : NULL);
+	next = currentThreadId;
+	savedSp[next] = sp;
+
+	if (next != old)
+		swapcontext(old >= 0 ? &contexts[old] : &bootContext, &contexts[next]);
+
+	hostPrimask = 0;
+	hostIpsr = 0;
+}
+
+/*
+ * Takes the pending interrupts and then a pending PendSV, as long as
+ * PRIMASK is clear and no handler runs: the exception return of the board.
+ * portLockSwitch holds off the PendSV only, as BASEPRI does there.
+ */
+void hostService(void){
+	uint32_t irqs;
+
+	while (hostPrimask == 0 && hostIpsr == 0){
+		if (hostPending == 0 && (!(hostScb.ICSR & SCB_ICSR_PENDSVSET_Msk) || switchLocked))
+			return;
+
+		//a signal that comes in now sees a handler running and only pends
+		hostIpsr = EXCEPTION_SYSTICK;
+		irqs = __atomic_exchange_n(&hostPending, 0, __ATOMIC_SEQ_CST);
+
+		if (irqs != 0){
+			hostMonitor = NULL;
+			if ((irqs & HOST_IRQ_SYSTICK) && (hostSysTick.CTRL & SysTick_CTRL_ENABLE_Msk)){
+				hostIpsr = EXCEPTION_SYSTICK;
+				SysTick_Handler();
+			}
+			if (irqs & HOST_IRQ_RTT){
+				hostIpsr = EXCEPTION_IRQ(RTT_IRQn);
+				RTT_Handler();
+			}
+			hostIpsr = 0;
+		} else {
+			hostIpsr = 0;
+			if ((hostScb.ICSR & SCB_ICSR_PENDSVSET_Msk) && !switchLocked)
+				hostPendSV();
+		}
+	}
+}
+
+/*
+ * The tick. Runs on the stack of whichever thread it interrupts, and may
+ * switch away from it right there; the thread comes back to finish the
+ * signal handler when it runs again.
+ */
+static void hostTick(int sig){
+	UNUSED(sig);
+
+	__atomic_or_fetch(&hostPending, HOST_IRQ_SYSTICK, __ATOMIC_SEQ_CST);
+	hostRttCheck();
+	hostService();
+}
+
+/*
+ * Starts the tick timer. It keeps running while the kernel has SysTick
+ * disabled, only the handler is skipped, so a tickless sleep still wakes
+ * up to check the RTT alarm.
+ */
+uint32_t SysTick_Config(uint32_t ticks){
+	struct sigaction sa;
+	struct itimerval timer;
+	uint32_t us = ticks / (HOST_CPU_HZ / 1000000);
+
+	hostSysTick.LOAD = ticks - 1;
+	hostSysTick.VAL = 0;
+	hostSysTick.CTRL = SysTick_CTRL_ENABLE_Msk;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = hostTick;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGALRM, &sa, NULL);
+
+	timer.it_interval.tv_sec = us / 1000000;
+	timer.it_interval.tv_usec = us % 1000000;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_REAL, &timer, NULL);
+	return 0;
+}
+
+/*
+ * WFI with PRIMASK set: a pending interrupt wakes the core up, but is only
+ * taken once PRIMASK is cleared. The tick stays blocked from the check
+ * until sigsuspend waits, so one that comes in between isn't lost.
+ */
+void hostWaitForInterrupt(void){
+	sigset_t tick, old, wait;
+
+	sigemptyset(&tick);
+	sigaddset(&tick, SIGALRM);
+	sigprocmask(SIG_BLOCK, &tick, &old);
+
+	wait = old;
+	sigdelset(&wait, SIGALRM);
+	if (hostPending == 0)
+		sigsuspend(&wait);
+
+	sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+/*
+ * Enables interrupts and waits for one, like the ASF sleep manager.
+ */
+void sleepmgr_sleep(enum sleepmgr_mode mode){
+	UNUSED(mode);
+
+	hostPrimask = 0;
+	hostService();
+	hostWaitForInterrupt();
+	hostService();
+}
+
+void delay_us(uint32_t us){
+	struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+
+	while (nanosleep(&ts, &ts) != 0);
+}
+
+/*
+ * Runs SVC_Switch on a frame laid out like the hardware stacks it: r0-r3,
+ * r12, lr, pc and psr, with pc just past an svc instruction that holds the
+ * code. The frame stays on the caller's stack while it is blocked, so the
+ * kernel can leave its result in r0.
+ */
+uint32_t hostSvc(uint8_t code, uint32_t r0, uint32_t r1, uint32_t r2, uint32_t r3){
+	uint8_t insn[2] = { code, 0xDF };
+	unsigned int frame[8] = { r0, r1, r2, r3, 0, 0, (unsigned int) (uintptr_t) (insn + 2), 0x01000000 };
+
+	if (hostPrimask != 0 || hostIpsr != 0){
+		//an SVC with interrupts masked or from a handler is a HardFault
+		fprintf(stderr, "SVC %u with PRIMASK %lu, IPSR %lu\n", code, (unsigned long) hostPrimask, (unsigned long) hostIpsr);
+		abort();
+	}
+
+	hostIpsr = EXCEPTION_SVCALL;
+	SVC_Switch(frame);
+	hostIpsr = 0;
+	hostService();
+
+	return frame[0];
+}
+
+/*
+ * First code of every thread, the entry of its context.
+ */
+static void hostThreadStart(int tid){
+	hostPrimask = 0;
+	hostIpsr = 0;
+	entries[tid]();
+	exitThread();
+}
+
+/*
+ * The stack from the pool isn't used, the thread runs on a host stack of
+ * its own, kept for the next thread that gets the same control block.
+ */
+uint32_t* portInitStack(int tid, uint32_t* top, void (*entry)(void)){
+	if (tid < 0 || tid >= HOST_MAX_THREADS)
+		abort();
+
+	if (stacks[tid] == NULL){
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+		#ifdef MAP_32BIT
+		flags |= MAP_32BIT;
+		#endif
+		stacks[tid] = mmap(NULL, HOST_STACK_BYTES, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (stacks[tid] == MAP_FAILED || (uintptr_t) stacks[tid] + HOST_STACK_BYTES > 0x100000000ULL){
+			perror("thread stack");
+			abort();
+		}
+	}
+
+	entries[tid] = entry;
+	getcontext(&contexts[tid]);
+	contexts[tid].uc_stack.ss_sp = stacks[tid];
+	contexts[tid].uc_stack.ss_size = HOST_STACK_BYTES;
+	contexts[tid].uc_link = NULL;
+	sigemptyset(&contexts[tid].uc_sigmask);
+	makecontext(&contexts[tid], (void (*)(void)) hostThreadStart, 1, tid);
+
+	//what PendSV_Handler would have pushed on the board
+	return top - 16;
+}
+
+void portSetPrivilege(bool privileged){
+	UNUSED(privileged);
+}
+
+//Host memory has no fixed map, only a null pointer is refused
+bool portWritable(uint32_t addr, uint32_t size){
+	UNUSED(size);
+	return addr != 0;
+}
+
+bool portReadable(uint32_t addr, uint32_t size){
+	return portWritable(addr, size);
+}
+
+//The text of the program, between the symbols the GNU linker defines
+bool portExecutable(uint32_t addr, uint32_t size){
+	extern char __executable_start[], etext[];
+
+	return addr >= (uintptr_t) __executable_start && addr < (uintptr_t) etext
+		&& size <= (uintptr_t) etext - addr;
+}
+
+void portLockSwitch(void){
+	switchLocked = true;
+}
+
+void portUnlockSwitch(void){
+	switchLocked = false;
+	hostService();
+}
+
+/*
+ * Switches to the first thread, as the first tick does on the board.
+ * Never returns.
+ */
+void hostStart(void){
+	hostScb.ICSR |= SCB_ICSR_PENDSVSET_Msk;
+	hostService();
+
+	while (1)
+		pause();
+}
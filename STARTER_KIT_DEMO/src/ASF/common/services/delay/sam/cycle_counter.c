@@ -56,3 +56,9 @@ void portable_delay_cycles(unsigned long n)
 		"BNE.N loop         "
 	);
 }
+
+void cpu_cycle_counter_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
@@ -103,6 +103,41 @@ void portable_delay_cycles(unsigned long n);
 #define cpu_delay_us(delay, f_cpu) delay_cycles(cpu_us_2_cy(delay, f_cpu))
 //! @}
 
+/**
+ * @name Cycle-accurate timing with the DWT cycle counter
+ *
+ * The DWT CYCCNT register counts every core clock cycle and wraps after
+ * 2^32 cycles, so unsigned differences of two readings are valid for any
+ * interval shorter than one wrap (about 35 seconds at 120 MHz).
+ *
+ * @{
+ */
+
+/**
+ * \brief Enable the DWT cycle counter.
+ *
+ * Must be called from privileged code. Calling it again is harmless and
+ * does not reset the counter.
+ */
+void cpu_cycle_counter_init(void);
+
+/**
+ * \brief Read the current value of the DWT cycle counter.
+ */
+static inline uint32_t cpu_cycle_counter_read(void)
+{
+	return DWT->CYCCNT;
+}
+
+/**
+ * \brief Number of cycles elapsed since \a start was read.
+ */
+static inline uint32_t cpu_cycles_since(uint32_t start)
+{
+	return DWT->CYCCNT - start;
+}
+//! @}
+
 
 #ifdef __cplusplus
 }
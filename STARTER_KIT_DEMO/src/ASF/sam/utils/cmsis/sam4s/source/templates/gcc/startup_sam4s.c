@@ -71,15 +71,8 @@ extern uint32_t _estack2;
 extern STACK1_SIZE;
 extern STACK2_SIZE;
 extern void startScheduler(void);
-int createThread(void (*startAddress) (void), char* name, int stackSize);
 extern void Initialize(void);
 
-/** \cond DOXYGEN_SHOULD_SKIP_THIS */
-int main(void);
-void thread_light(void);
-void thread_temp(void);
-/** \endcond */
-
 void __libc_init_array(void);
 
 /* Exception Table */
@@ -219,12 +212,7 @@ void Reset_Handler(void) {
     //Initializes the hardware for OS use.
     Initialize();
 
-    //Creates threads
-    createThread(&main, "main ", 128);
-    createThread(&thread_temp, "thread_temp ", 128);
-    createThread(&thread_light, "thread_light ", 128);
-
-    //Starts scheduler
+    //Starts scheduler with the threads of config/conf_threads.h
     startScheduler();
 
     //Sets thread mode to execute in unprivileged mode
@@ -0,0 +1,34 @@
+/*
+ * Batched syscalls
+ *
+ * User side of SYSCALL_BATCH. The kernel runs up to BATCH_MAX ops per SVC
+ * and stops after a delay, returning how many it ran; the rest go in the
+ * next SVC.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include "sysnums.h"
+#include "batch.h"
+
+int batch(BatchOp* ops, int count) {
+    uint32_t ran;
+    int done = 0;
+    int refused = 0;
+    int i;
+
+    while (done < count) {
+        ran = svc_r0_r1(SYSCALL_BATCH, &ops[done], count - done);
+        if (ran == SYSCALL_ERROR)
+            return -1;
+        done += ran;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (ops[i].status == BATCH_REFUSED)
+            refused++;
+    }
+    return refused;
+}
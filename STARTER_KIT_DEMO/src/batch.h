@@ -0,0 +1,65 @@
+/*
+ * Batched syscalls
+ *
+ * A list of screen, LED and sensor operations the kernel runs in a single
+ * SVC, so redrawing a menu page costs one kernel entry instead of one for
+ * every line and LED. The kernel writes the outcome of each one in its
+ * status. device.h runs the same lists on the device thread instead.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//BatchOp.op
+#define BATCH_LED			0	//turns LED led (0-3) on or off
+#define BATCH_TEXT			1	//writes text at line (0-3) and column (0-127)
+#define BATCH_CLEAR			2	//clears the screen
+#define BATCH_DELAY			3	//sleeps for ms, the ops after it run once the thread wakes up
+#define BATCH_GETTEMP		4	//reads the temperature sensor into *temperature
+
+//BatchOp.status
+#define BATCH_PENDING		1	//not run yet
+#define BATCH_DONE			0
+#define BATCH_REFUSED		-1	//unknown op, bad argument or the device failed
+
+//Most ops the kernel runs in one SVC, batch() issues more for longer lists.
+//Bounds the time spent in handler mode
+#define BATCH_MAX			16
+
+typedef struct{
+	uint8_t op;
+	union{
+		uint8_t line;
+		uint8_t led;
+	};
+	uint8_t column;
+	int8_t status;				//set by the kernel
+	union{
+		const char* text;
+		uint32_t ms;
+		bool on;
+		double* temperature;
+	};
+}BatchOp;
+
+#define BATCH_OP_LED(n, state)	{ .op = BATCH_LED, .led = (n), .status = BATCH_PENDING, .on = (state) }
+#define BATCH_OP_TEXT(s, l, c)	{ .op = BATCH_TEXT, .line = (l), .column = (c), .status = BATCH_PENDING, .text = (s) }
+#define BATCH_OP_CLEAR()		{ .op = BATCH_CLEAR, .status = BATCH_PENDING }
+#define BATCH_OP_DELAY(t)		{ .op = BATCH_DELAY, .status = BATCH_PENDING, .ms = (t) }
+#define BATCH_OP_GETTEMP(t)		{ .op = BATCH_GETTEMP, .status = BATCH_PENDING, .temperature = (t) }
+
+// Runs the count ops in order. Returns how many the kernel refused, or -1
+// if it refused the list itself
+int batch( BatchOp* ops, int count );
+
+// Kernel side, in syscalls.c: runs op, any but BATCH_DELAY, and returns its
+// status
+int8_t batchRunOp( BatchOp* op );
+
+#endif /* BATCH_H_ */
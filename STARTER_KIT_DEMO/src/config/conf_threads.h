@@ -0,0 +1,33 @@
+/*
+ * Static threads
+ *
+ * Threads that exist from boot. The scheduler lays out their control blocks
+ * and stacks at compile time (see scheduler.c), and startScheduler builds
+ * their first frames. Their stacks are named after them in the map file,
+ * as <id>Stack.
+ *
+ * THREAD(id, entry, name, stack words, priority, slice in ms, privileged)
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef CONF_THREADS_H_
+#define CONF_THREADS_H_
+
+#include "minios.h"
+
+int main(void);
+void thread_load(void);
+void thread_temp(void);
+void thread_light(void);
+
+//The menu and the display preempt the sensor threads as soon as they
+//wake up and switch often; the sensor threads take turns on long slices
+#define STATIC_THREADS(THREAD) \
+	THREAD(main,	main,			"main ",			128,	PRIORITY_NORMAL - 2,	1,	false) \
+	THREAD(load,	thread_load,	"thread_load ",		256,	PRIORITY_NORMAL - 1,	1,	false) \
+	THREAD(temp,	thread_temp,	"thread_temp ",		128,	PRIORITY_NORMAL,		20,	false) \
+	THREAD(light,	thread_light,	"thread_light ",	128,	PRIORITY_NORMAL,		20,	false)
+
+#endif /* CONF_THREADS_H_ */
@@ -133,6 +133,8 @@
   extern bool my_callback_cdc_enable(void);
   #define UDI_CDC_DISABLE_EXT(port) my_callback_cdc_disable()
   extern void my_callback_cdc_disable(void);
+  #define UDI_CDC_RX_NOTIFY(port) my_callback_rx_notify(port)
+  extern void my_callback_rx_notify(uint8_t port);
  /* #define  UDI_CDC_RX_NOTIFY(port) my_callback_rx_notify(port)
  * extern void my_callback_rx_notify(uint8_t port);
  * #define  UDI_CDC_TX_EMPTY_NOTIFY(port) my_callback_tx_empty_notify(port)
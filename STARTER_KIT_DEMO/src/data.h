@@ -1,6 +1,6 @@
 /*
  * Data.
- * These variables are used to store data shared between threads.
+ * These queues carry data from interrupt handlers to threads.
  *
  *  Author: Devon Harker, Josh Haskins, Vincent Tennant
  */ 
@@ -9,8 +9,15 @@
 #ifndef DATA_H_
 #define DATA_H_
 
-double volatile temp;
-uint32_t volatile adc_value;
-uint32_t volatile light;
+#include "ring.h"
+
+//Light sensor readings, sent by the ADC interrupt to thread_light
+extern Ring light_samples;
+
+//Buttons pressed, sent to main once the worker thread handled them
+extern Ring button_events;
+
+//Bytes received on the USB CDC stdio
+extern Ring stdin_bytes;
 
 #endif /* DATA_H_ */
\ No newline at end of file
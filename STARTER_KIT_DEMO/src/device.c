@@ -0,0 +1,134 @@
+/*
+ * Device requests
+ *
+ * Requests come through a multi-producer ring, like work items. The
+ * syscall copies what the device thread needs out of the request once it
+ * has checked it, so a thread changing the request after submitting it
+ * can't point the device thread at memory the check didn't cover.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include "minios.h"
+#include "sysnums.h"
+#include "scheduler.h"
+#include "ring.h"
+#include "port.h"
+#include "device.h"
+
+#define DEVICE_SLOTS			8
+#define DEVICE_STACK_SIZE		256
+
+//takes turns with the sensor threads, which submit most of the requests
+#define DEVICE_PRIORITY			PRIORITY_NORMAL
+
+typedef struct{
+	DeviceRequest* req;
+	BatchOp* ops;
+	EventFlags* done;
+	uint32_t doneFlags;
+	DeviceCallback callback;
+	uint8_t count;
+}DeviceJob;
+
+MPSC_RING_DEFINE(deviceRing, DeviceJob, DEVICE_SLOTS);
+
+Mutex deviceScreenLock = MUTEX_INIT;
+Mutex deviceSensorLock = MUTEX_INIT;
+
+/*
+ * The lock of the device op uses, NULL for the LEDs, which are a single
+ * register write.
+ */
+static Mutex* deviceLock(BatchOp* op){
+	switch (op->op){
+		case BATCH_TEXT:
+		case BATCH_CLEAR: return &deviceScreenLock;
+		case BATCH_GETTEMP: return &deviceSensorLock;
+		default: return NULL;
+	}
+}
+
+/*
+ * Kernel thread that runs the requests in order.
+ */
+static void deviceThread(void){
+	DeviceJob job;
+	BatchOp* op;
+	Mutex* lock;
+	int refused, i;
+
+	while (1){
+		if (ringReceive(&deviceRing, &job, WAIT_FOREVER) != 0)
+			continue;
+
+		refused = 0;
+		for (i = 0; i < job.count; i++){
+			op = &job.ops[i];
+
+			if (op->op == BATCH_DELAY){
+				op->status = BATCH_DONE;
+				svc_r0(SYSCALL_DELAY, op->ms);
+				continue;
+			}
+
+			lock = deviceLock(op);
+			if (lock != NULL)
+				mutexLock(lock, WAIT_FOREVER);
+			op->status = batchRunOp(op);
+			if (lock != NULL)
+				mutexUnlock(lock);
+
+			if (op->status == BATCH_REFUSED)
+				refused++;
+		}
+
+		if (job.callback != NULL)
+			job.callback(job.req);
+		if (job.done != NULL)
+			eventSet(job.done, job.doneFlags);
+
+		//the status hands the request back, so nothing may touch it after.
+		//A waiter the post wakes up only runs once it is set
+		portLockSwitch();
+		semPost(&job.req->finished);
+		job.req->status = refused;
+		portUnlockSwitch();
+	}
+}
+
+/*
+ * Starts the device thread, along with the scheduler.
+ */
+void deviceInit(void){
+	createKernelThread(&deviceThread, "device ", DEVICE_STACK_SIZE, DEVICE_PRIORITY);
+}
+
+int deviceQueue(DeviceRequest* req){
+	DeviceJob job = { req, req->ops, req->done, req->doneFlags, req->callback, req->count };
+
+	if (req->status == DEVICE_PENDING)
+		return -1;
+
+	//posts left from requests nobody waited for. No thread can be waiting
+	//on a request that isn't pending
+	semInit(&req->finished, 0);
+	req->status = DEVICE_PENDING;
+	if (!ringSend(&deviceRing, &job)){
+		req->status = 0;
+		return -1;
+	}
+	return 0;
+}
+
+int deviceSubmit(DeviceRequest* req){
+	return (int) svc_r0(SYSCALL_DEVICE_SUBMIT, req);
+}
+
+int deviceWait(DeviceRequest* req){
+	while (req->status == DEVICE_PENDING)
+		semWait(&req->finished, WAIT_FOREVER);
+	return req->status;
+}
@@ -0,0 +1,70 @@
+/*
+ * Device requests
+ *
+ * Runs a list of batch ops (batch.h) on the device thread instead of in the
+ * SVC handler. deviceSubmit returns as soon as the request is queued, so
+ * the caller can go on and only wait once it needs the result. The thread
+ * runs one op at a time with interrupts and switches live, holding the
+ * lock of the device the op uses. Meant for the slow ones: the temperature
+ * read over TWI and text on the screen, which the synchronous syscalls run
+ * entirely in handler mode.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef DEVICE_H_
+#define DEVICE_H_
+
+#include <stdint.h>
+#include "sync.h"
+#include "batch.h"
+
+//DeviceRequest.status while it is queued or running. After that, the
+//number of its ops that were refused; the device thread is done with the
+//request once it is set
+#define DEVICE_PENDING		-1
+
+//Held by the device thread while it runs a screen op and a sensor op. A
+//thread that uses the screen or the sensor through the synchronous
+//syscalls takes them too, so its calls don't land in the middle of an op.
+//Not held while waiting for a request that uses the same device
+extern Mutex deviceScreenLock;
+extern Mutex deviceSensorLock;
+
+struct DeviceRequest;
+
+// Called by the device thread once the ops of a request have run, before
+// its status is set. Runs privileged, on
+// the stack of the device thread, and must not block. Has to be in flash,
+// deviceSubmit refuses a request whose callback is anywhere else
+typedef void (*DeviceCallback)(struct DeviceRequest*);
+
+typedef struct DeviceRequest{
+	BatchOp* ops;
+	uint8_t count;
+	volatile int8_t status;
+	uint32_t doneFlags;			//set in done once the request is done
+	EventFlags* done;			//may be NULL
+	DeviceCallback callback;	//may be NULL
+	Semaphore finished;			//posted once it is done, for deviceWait
+}DeviceRequest;
+
+#define DEVICE_REQUEST_INIT(ops, count, done, flags, callback) \
+	{ (ops), (count), 0, (flags), (done), (callback), SEMAPHORE_INIT(0) }
+
+void deviceInit(void);
+
+// Queues req for the device thread. A delay in it holds up the requests
+// queued after it. Returns 0, or -1 if req is still pending, an argument
+// is bad or the queue is full
+int deviceSubmit( DeviceRequest* req );
+
+// Blocks until req is done, whether or not it has event flags. Returns its
+// status. Only one thread may wait for a request
+int deviceWait( DeviceRequest* req );
+
+// Kernel side: queues req, checked by the syscall, and returns 0 or -1
+int deviceQueue( DeviceRequest* req );
+
+#endif /* DEVICE_H_ */
@@ -53,11 +53,15 @@
 #include "sysnums.h"
 #include "data.h"
 #include "threads.h"
+#include "sync.h"
+#include "workqueue.h"
+#include "proto.h"
+#include "batch.h"
+#include "device.h"
+#include "trace.h"
 
 #define BUFFER_SIZE				128
 
-#define svc(code) asm volatile ("svc %[immediate]"::[immediate] "I" (code))
-
 #define LIGHT_OFF               false //this is correct, true = off, false = on
 #define LIGHT_ON				!LIGHT_OFF
 
@@ -77,6 +81,13 @@
 #define MODE_ON					1
 #define MODE_OFF				0
 
+/* Presses of a button closer than this to the last one are bounces */
+#define BUTTON_DEBOUNCE_MS		200
+
+/* The sensor threads sample every 65 ms, each job within 10 ms of cpu */
+#define SENSOR_PERIOD_US		65000
+#define SENSOR_BUDGET_US		10000
+
 /* IRQ priority for PIO (The lower the value, the greater the priority) */
 #define IRQ_PRIOR_PIO			0
 
@@ -97,8 +108,19 @@ FATFS fs;
 bool app_mode = DISABLED;
 bool volatile temp_mode = DISABLED;
 int volatile light_mode = DISABLED;
+bool volatile load_mode = DISABLED;
+bool volatile load_dump = false;
 int menu_mode = MENU_NO_MENU;
 int current_temp, current_light;
+
+MPSC_RING_DEFINE(button_events, uint8_t, 8);
+RING_DEFINE(light_samples, uint16_t, 4);
+
+//Set while the app of the same name is on, its thread blocks otherwise
+#define APP_TEMP				0x01
+#define APP_LIGHT				0x02
+#define APP_LOAD				0x04
+EventFlags app_modes = EVENT_FLAGS_INIT;
 char value_disp[5], temp_disp[5], light_disp[5];
 
 /*
@@ -139,61 +161,70 @@ void controlLight3(bool c) {
 }
 
 /*
- * Controls all lights
+ * Controls all lights, in one syscall
  */
 void controlLights(bool a, bool b, bool c) {
-    //LED1 off
-    if (a)
-        svc(3);
-        //LED1 on
-    else
-        svc(2);
-
-    //LED2 off
-    if (b)
-        svc(5);
-        //LED2 on
-    else
-        svc(4);
-
-    //LED3 off
-    if (c)
-        svc(7);
-        //LED3 on
-    else
-        svc(6);
+    BatchOp ops[] = {
+        BATCH_OP_LED(1, a),
+        BATCH_OP_LED(2, b),
+        BATCH_OP_LED(3, c),
+    };
 
+    batch(ops, 3);
 }
 
 /*
  * Prints char to screen.
  */
-__attribute__((noinline)) void printChar(char* c) {
-    svc(SYSCALL_WRITECHARTOSCREEN);
+void printChar(char* c) {
+    svc_r0(SYSCALL_WRITECHARTOSCREEN, c);
 }
 
 /*
  * Prints string to screen.
  */
-__attribute__((noinline)) void printString(char* c, int l) {
-    svc(SYSCALL_WRITESTRINGTOSCREEN);
+void printString(char* c, int l) {
+    svc_r0_r1(SYSCALL_WRITESTRINGTOSCREEN, c, l);
 }
 
 /*
  * Prints string to screen, allows position to be set.
  */
-__attribute__((noinline)) void printStringPosition(char* c, int l, int x) {
-    svc(SYSCALL_WRITESTRINGTOSCREENPOSITION);
+void printStringPosition(char* c, int l, int x) {
+    svc_r0_r3(SYSCALL_WRITESTRINGTOSCREENPOSITION, c, l, x, 0);
 }
 
 /*
  * Print 4 lines of text to screen.
  */
 void print4screen(char* a, char* b, char* c, char* d) {
-    printString(a, 0);
-    printString(b, 1);
-    printString(c, 2);
-    printString(d, 3);
+    BatchOp ops[] = {
+        BATCH_OP_TEXT(a, 0, 0),
+        BATCH_OP_TEXT(b, 1, 0),
+        BATCH_OP_TEXT(c, 2, 0),
+        BATCH_OP_TEXT(d, 3, 0),
+    };
+
+    batch(ops, 4);
+}
+
+/*
+ * Draws a page of the menu: sets the lights, clears the screen and prints
+ * its 4 lines, all in one syscall.
+ */
+void drawMenu(bool l1, bool l2, bool l3, char* a, char* b, char* c, char* d) {
+    BatchOp ops[] = {
+        BATCH_OP_LED(1, l1),
+        BATCH_OP_LED(2, l2),
+        BATCH_OP_LED(3, l3),
+        BATCH_OP_CLEAR(),
+        BATCH_OP_TEXT(a, 0, 0),
+        BATCH_OP_TEXT(b, 1, 0),
+        BATCH_OP_TEXT(c, 2, 0),
+        BATCH_OP_TEXT(d, 3, 0),
+    };
+
+    batch(ops, 8);
 }
 
 /*
@@ -225,22 +256,33 @@ void cleanScreen() {
  * Delay. Uses ms. 
  */
 void delay(int d) {
-    svc(SYSCALL_DELAY);
+    svc_r0(SYSCALL_DELAY, d);
+}
+
+/*
+ * Gives up the rest of the time slice.
+ */
+void yield() {
+    svc(SYSCALL_YIELD);
 }
 
 /*
  * Gets temperature from sensor.
  */
 void getTemp(double* t) {
-    svc(SYSCALL_GETTEMP);
+    svc_r0(SYSCALL_GETTEMP, t);
 }
 
 /*
- * Gets light info from light sensor.
+ * Gets light info from light sensor, as a percentage. Left as it
+ * is if the ADC interrupt doesn't send a sample back in time.
  */
-void getLight() {
+void getLight(uint32_t* light) {
+    uint16_t sample;
+
     svc(SYSCALL_GETLIGHT);
-    light = 100 - (adc_value * 100 / 4096);
+    if (ringReceive(&light_samples, &sample, 10) == 0)
+        *light = 100 - (sample * 100 / 4096);
 }
 
 /*
@@ -319,86 +361,95 @@ void app_text3() {
 }
 
 /*
- * Thread, that turns on and off light 1.
- */
-void app_light1() {
-    delay(210);
-    int x = 0;
-    int int_delay = 130;
-    while (x < 4) {
-        x++;
-        controlLight1(LIGHT_ON);
-        delay(int_delay);
-
-        controlLight1(LIGHT_OFF);
-        delay(int_delay);
+ * A light app: turns one light on and off a few times. They are
+ * protothreads, so the three of them share the dispatcher's stack.
+ */
+typedef struct {
+    ProtoTask task;
+    void (*light)(bool);
+    uint32_t start_delay;
+    uint32_t int_delay;
+    int blinks;
+    int x;
+} LightApp;
+
+static int app_light(ProtoTask* pt) {
+    LightApp* app = (LightApp*) pt;
+
+    PT_BEGIN(pt);
+    PT_DELAY(pt, app->start_delay);
+    for (app->x = 0; app->x < app->blinks; app->x++) {
+        app->light(LIGHT_ON);
+        PT_DELAY(pt, app->int_delay);
+
+        app->light(LIGHT_OFF);
+        PT_DELAY(pt, app->int_delay);
     }
+    PT_END(pt);
 }
 
-/*
- * Thread, that turns on and off light 2.
- */
-void app_light2() {
-    delay(220);
-    int x = 0;
-    int int_delay = 120;
-    while (x < 4) {
-        x++;
-        controlLight2(LIGHT_ON);
-        delay(int_delay);
-
-        controlLight2(LIGHT_OFF);
-        delay(int_delay);
-    }
-}
+LightApp app_light1 = { PROTO_TASK_INIT(&app_light, "app_light1 "), controlLight1, 210, 130, 4, 0 };
+LightApp app_light2 = { PROTO_TASK_INIT(&app_light, "app_light2 "), controlLight2, 220, 120, 4, 0 };
+LightApp app_light3 = { PROTO_TASK_INIT(&app_light, "app_light3 "), controlLight3, 230, 110, 7, 0 };
 
-/*
- * Thread, that turns on and off light 3.
- */
-void app_light3() {
-    delay_ms(230);
-    int x = 0;
-    int int_delay = 110;
-    while (x < 7) {
-        x++;
-        controlLight3(LIGHT_ON);
-        delay_ms(int_delay);
-
-        controlLight3(LIGHT_OFF);
-        delay_ms(int_delay);
-    }
-}
+//The sensor read of thread_temp, run by the device thread
+static double temp_reading;
+static BatchOp temp_read = BATCH_OP_GETTEMP(&temp_reading);
+static DeviceRequest temp_request = DEVICE_REQUEST_INIT(&temp_read, 1, NULL, 0, NULL);
 
 /*
  * Thread, prints the temperature sensor to the screen.
  */
 void thread_temp() {
-    delay_ms(133);
+    delay(133);
+    double temp = 0;
     int itt = 1;
+    bool periodic = false;
     temp_mode = DISABLED;
     while (1) {
         if (temp_mode == ENABLED) {
+            if (!periodic) {
+                periodicStart(SENSOR_PERIOD_US, 0, SENSOR_BUDGET_US);
+                periodic = true;
+            }
+
             if (itt % 2) {
-                getTemp(&temp);
+                //takes the last reading and asks for the next one, which
+                //goes on over TWI while this thread waits for its period
+                if (temp_request.status != DEVICE_PENDING) {
+                    if (temp_read.status == BATCH_DONE)
+                        temp = temp_reading;
+                    deviceSubmit(&temp_request);
+                }
             } else {
                 sprintf(temp_disp, "%d", (uint8_t) temp);
+                mutexLock(&deviceScreenLock, WAIT_FOREVER);
                 printStringPosition(temp_disp, 1, 106);
                 printStringPosition("c", 1, 119);
-            }
-            itt++;
-            delay_ms(65);
 
-            if (temp > 22) {
-                printStringPosition("VERY HOT", 2, 87);
-            } else if (temp < 21) {
-                printStringPosition("TOO COLD", 2, 87);
-            } else {
-                printStringPosition("__________", 2, 87);
+                if (temp > 22) {
+                    printStringPosition("VERY HOT", 2, 87);
+                } else if (temp < 21) {
+                    printStringPosition("TOO COLD", 2, 87);
+                } else {
+                    printStringPosition("__________", 2, 87);
+                }
+                mutexUnlock(&deviceScreenLock);
             }
+            itt++;
+            periodicWait();
 
         } else if (temp_mode == DISABLED) {
+            //no releases to miss while it waits
+            periodicStop();
+            periodic = false;
+
+            mutexLock(&deviceScreenLock, WAIT_FOREVER);
             printStringPosition("       ", 1, 106);
             printStringPosition("__________", 2, 87);
+            mutexUnlock(&deviceScreenLock);
+
+            eventWait(&app_modes, APP_TEMP, EVENT_WAIT_ANY, WAIT_FOREVER);
         }
 
     }
@@ -410,26 +461,33 @@ void thread_temp() {
 void launchApp() {
     switch (menu_screen) {
         case 2:
-            //app_mode = ENABLED;
-            //menu_mode = MENU_NO_MENU;
-            //ssd1306_clear();
-
-            //createThread( &app_light1, "app_light1 ", 128 );
-            //createThread( &app_light2, "app_light2 ", 128 );
-            //createThread( &app_light3, "app_light3 ", 128 );
+            //thread_load draws the cpu load of the threads
+            app_mode = ENABLED;
+            menu_mode = MENU_NO_MENU;
+            load_mode = ENABLED;
+            eventSet(&app_modes, APP_LOAD);
+
+            //blinks the lights while the load is drawn
+            protoStart(&app_light1.task);
+            protoStart(&app_light2.task);
+            protoStart(&app_light3.task);
             break;
         case 3:
             if (temp_mode == ENABLED) {
                 temp_mode = DISABLED;
+                eventClear(&app_modes, APP_TEMP);
             } else if (temp_mode == DISABLED) {
                 temp_mode = ENABLED;
+                eventSet(&app_modes, APP_TEMP);
             }
             break;
         case 4:
             if (light_mode == ENABLED) {
                 light_mode = DISABLED;
+                eventClear(&app_modes, APP_LIGHT);
             } else {
                 light_mode = ENABLED;
+                eventSet(&app_modes, APP_LIGHT);
             }
             break;
         case 5:
@@ -464,11 +522,16 @@ void boot() {
 }
 
 /*
- * Process Buttons Events.
+ * Process Buttons Events. Runs in the kernel worker thread, queued by the
+ * button interrupts with the time of the press.
  */
-static void ProcessButtonEvt(uint8_t uc_button) {
+static void ProcessButtonEvt(uint32_t uc_button, uint32_t stampMs) {
+    static uint32_t last_press[4];
+    uint8_t button = uc_button;
 
-    delay_ms(200);
+    if (last_press[uc_button] != 0 && stampMs - last_press[uc_button] < BUTTON_DEBOUNCE_MS)
+        return;
+    last_press[uc_button] = stampMs;
 
     //All Menu clicks
     if (menu_mode == MENU_MAIN && !app_mode) {
@@ -480,7 +543,7 @@ static void ProcessButtonEvt(uint8_t uc_button) {
             menu_screen_switch = 1;
             menu_screen = 2;
         } else if (uc_button == 2 && menu_screen == 2) {
-            //launchApp();
+            launchApp();
         } else if (uc_button == 3) {
             menu_screen_switch = 1;
         }
@@ -506,12 +569,14 @@ static void ProcessButtonEvt(uint8_t uc_button) {
 
             menu_mode = MENU_APP;
             app_mode = DISABLED;
+            load_mode = DISABLED;
+            eventClear(&app_modes, APP_LOAD);
             screen_extension = 3;
             menu_screen = 2;
             menu_screen_switch = 1;
 
         } else if (uc_button == 2) {
-            //TODO, add something here
+            load_dump = true;
         } else if (uc_button == 3) {
             //TODO, add something here
         }
@@ -522,6 +587,8 @@ static void ProcessButtonEvt(uint8_t uc_button) {
         menu_screen_switch = 1;
     }
 
+    ringSend(&button_events, &button);
+
 
 
 }
@@ -530,24 +597,30 @@ static void ProcessButtonEvt(uint8_t uc_button) {
  * Handler for Button 1 rising edge interrupt.
  */
 static void Button1_Handler(uint32_t id, uint32_t mask) {
+    TRACE(TRACE_ISR_ENTER, __get_IPSR());
     if ((PIN_PUSHBUTTON_1_ID == id) && (PIN_PUSHBUTTON_1_MASK == mask))
-        ProcessButtonEvt(1);
+        workQueue(ProcessButtonEvt, 1);
+    TRACE(TRACE_ISR_EXIT, __get_IPSR());
 }
 
 /**
  * brief Handler for Button 2 rising edge interrupt.
  */
 static void Button2_Handler(uint32_t id, uint32_t mask) {
+    TRACE(TRACE_ISR_ENTER, __get_IPSR());
     if ((PIN_PUSHBUTTON_2_ID == id) && (PIN_PUSHBUTTON_2_MASK == mask))
-        ProcessButtonEvt(2);
+        workQueue(ProcessButtonEvt, 2);
+    TRACE(TRACE_ISR_EXIT, __get_IPSR());
 }
 
 /**
  * brief Handler for Button 3 rising edge interrupt.
  */
 static void Button3_Handler(uint32_t id, uint32_t mask) {
+    TRACE(TRACE_ISR_ENTER, __get_IPSR());
     if ((PIN_PUSHBUTTON_3_ID == id) && (PIN_PUSHBUTTON_3_MASK == mask))
-        ProcessButtonEvt(3);
+        workQueue(ProcessButtonEvt, 3);
+    TRACE(TRACE_ISR_EXIT, __get_IPSR());
 }
 
 
@@ -600,7 +673,24 @@ static void configure_adc(void) {
     /* Configure ADC. */
     adc_init(ADC, sysclk_get_cpu_hz(), 1000000, ADC_MR_STARTUP_SUT0);
     adc_enable_channel(ADC, ADC_CHANNEL_4);
-    adc_configure_trigger(ADC, ADC_TRIG_SW, 1);
+    adc_configure_trigger(ADC, ADC_TRIG_SW, 0);
+
+    /* Conversions are started on request, the result comes by interrupt. */
+    adc_enable_interrupt(ADC, ADC_IER_EOC4);
+    NVIC_EnableIRQ(ADC_IRQn);
+}
+
+/**
+ * Handler for the ADC end of conversion. Sends the light sensor reading to
+ * whoever asked for it.
+ */
+void ADC_Handler(void) {
+    uint16_t sample;
+
+    if (adc_get_status(ADC) & ADC_ISR_EOC4) {
+        sample = adc_get_channel_value(ADC, ADC_CHANNEL_4);
+        ringSend(&light_samples, &sample);
+    }
 }
 
 /**
@@ -619,26 +709,30 @@ static void ssd1306_clear_char(void) {
  * Main. Is the GUI of the entire OS.
  */
 int main(void) {
+    uint8_t button;
 
     while (true) {
 
         if (!app_mode && menu_mode == MENU_NO_MENU) {
             //Welcome Screen
-            controlLights(LIGHT_ON, LIGHT_ON, LIGHT_ON);
-            ssd1306_clear(); // Clear screen.
-            print4screen("              Welcome to", "              deJovi SOS", "________________________________", " click any button to continue");
+            mutexLock(&deviceScreenLock, WAIT_FOREVER);
+            drawMenu(LIGHT_ON, LIGHT_ON, LIGHT_ON, "              Welcome to", "              deJovi SOS", "________________________________", " click any button to continue");
+            mutexUnlock(&deviceScreenLock);
 
             menu_screen_switch = 0;
 
             while (menu_screen_switch == 0) {
-                continue;
+                ringReceive(&button_events, &button, WAIT_FOREVER);
             }
             menu_screen_switch = 1;
             menu_mode = MENU_MAIN;
+
+            //draw the menu right away, not on the next press
+            continue;
         } else if (!app_mode && (menu_mode == MENU_MAIN || menu_mode == MENU_APP)) {
             if (menu_screen_switch != 0) {
 
-                delay_ms(50); //delay needed to stop skipping
+                delay(50); //delay needed to stop skipping
 
                 /* Refresh page title only if necessary. */
                 if (menu_screen_switch == 1) {
@@ -651,54 +745,46 @@ int main(void) {
                     }
                 }
 
-                // Clear screen.
-                cleanScreen();
-                ssd1306_set_page_address(0);
-                ssd1306_set_column_address(0);
+                mutexLock(&deviceScreenLock, WAIT_FOREVER);
 
                 /* Built in app Mode. */
                 if (menu_screen == 0) {
-                    controlLights(LIGHT_ON, LIGHT_OFF, LIGHT_OFF);
-                    print4screen("Built in Apps", "Choose a built in app", "________________________________", " <-             Launch             ->");
+                    drawMenu(LIGHT_ON, LIGHT_OFF, LIGHT_OFF, "Built in Apps", "Choose a built in app", "________________________________", " <-             Launch             ->");
                     //browseApps();
                 }
 				/* Load app mode. */
                 else if (menu_screen == 1) {
-                    controlLights(LIGHT_OFF, LIGHT_ON, LIGHT_OFF);
-                    print4screen("Load Apps from SD Card", "It's a cheap app store", "________________________________", " <-             Launch             ->");
+                    drawMenu(LIGHT_OFF, LIGHT_ON, LIGHT_OFF, "Load Apps from SD Card", "It's a cheap app store", "________________________________", " <-             Launch             ->");
 
                 }
 				/* Thread Demo Mode. */
                 else if (menu_screen == 2) {
-                    controlLights(LIGHT_OFF, LIGHT_OFF, LIGHT_ON);
-                    print4screen("Thread Demo Mode", "See those threads run", "________________________________", " <-             Launch             ->");
+                    drawMenu(LIGHT_OFF, LIGHT_OFF, LIGHT_ON, "Thread Demo Mode", "See those threads run", "________________________________", " <-             Launch             ->");
 
 
                 }
 				/* Temp Mode. */
                 else if (menu_screen == 3) {
-                    controlLights(LIGHT_ON, LIGHT_OFF, LIGHT_OFF);
-                    print4screen("Temperature Mode", "How cold is it?", "________________________________", " Back          Launch            ->");
+                    drawMenu(LIGHT_ON, LIGHT_OFF, LIGHT_OFF, "Temperature Mode", "How cold is it?", "________________________________", " Back          Launch            ->");
 
                 }
 				/* Light Mode. */
                 else if (menu_screen == 4) {
-                    controlLights(LIGHT_ON, LIGHT_ON, LIGHT_OFF);
-                    print4screen("Light Mode", "Turn those lights off", "________________________________", " Back          Launch            ->");
+                    drawMenu(LIGHT_ON, LIGHT_ON, LIGHT_OFF, "Light Mode", "Turn those lights off", "________________________________", " Back          Launch            ->");
 
                 }
 				/* Thread Mode. */
                 else if (menu_screen == 5) {
-                    controlLights(LIGHT_ON, LIGHT_ON, LIGHT_ON);
-                    print4screen("Thread Demo Mode", "Demo of threads", "________________________________", " Back          Launch            ->");
+                    drawMenu(LIGHT_ON, LIGHT_ON, LIGHT_ON, "Thread Demo Mode", "Demo of threads", "________________________________", " Back          Launch            ->");
 
                 }
+                mutexUnlock(&deviceScreenLock);
                 menu_screen_switch = 0;
             }
         }
 
-        /* Wait and stop screen flickers. */
-        delay_ms(100);
+        /* Sleep until a button changes something. */
+        ringReceive(&button_events, &button, WAIT_FOREVER);
     }
 }
 
@@ -713,6 +799,11 @@ void Initialize(void) {
     irq_initialize_vectors();
     cpu_irq_enable();
 
+    // Initialize the sleep manager. The buttons can't wake the chip up
+    // from wait mode, so don't sleep deeper than WFI.
+    sleepmgr_init();
+    sleepmgr_lock_mode(SLEEPMGR_SLEEP_WFI);
+
     // Initialize GPIO states.
     board_init();
 
@@ -733,30 +824,121 @@ void Initialize(void) {
  * Thread, displays the light percentage on the screen.
  */
 void thread_light() {
-    delay_ms(100);
+    delay(100);
+    uint32_t light = 0;
     int itt = 1;
+    bool periodic = false;
     while (1) {
         if (light_mode != DISABLED) {
+            if (!periodic) {
+                periodicStart(SENSOR_PERIOD_US, 0, SENSOR_BUDGET_US);
+                periodic = true;
+            }
+
             if (itt % 2) {
-                getLight();
+                getLight(&light);
             } else {
                 sprintf(light_disp, "%d", light);
+                mutexLock(&deviceScreenLock, WAIT_FOREVER);
                 printStringPosition(light_disp, 0, 106);
                 printStringPosition("%", 0, 119);
-            }
-            itt++;
-            delay_ms(65);
 
-            if (light < 20) {
-                printStringPosition("VERY DARK", 2, 0);
-            } else if (light > 80) {
-                printStringPosition("TOO BRIGHT", 2, 0);
-            } else {
-                printStringPosition("_____________", 2, 0);
+                if (light < 20) {
+                    printStringPosition("VERY DARK", 2, 0);
+                } else if (light > 80) {
+                    printStringPosition("TOO BRIGHT", 2, 0);
+                } else {
+                    printStringPosition("_____________", 2, 0);
+                }
+                mutexUnlock(&deviceScreenLock);
             }
+            itt++;
+            periodicWait();
         } else {
+            periodicStop();
+            periodic = false;
+
+            mutexLock(&deviceScreenLock, WAIT_FOREVER);
             printStringPosition("      ", 0, 106);
             printStringPosition("_____________", 2, 0);
+            mutexUnlock(&deviceScreenLock);
+
+            eventWait(&app_modes, APP_LIGHT, EVENT_WAIT_ANY, WAIT_FOREVER);
+        }
+    }
+}
+
+#define LOAD_VIEW_THREADS		16
+#define LOAD_VIEW_PERIOD_MS		1000
+
+/**
+ * Thread, shows the threads using the most cpu since the last refresh,
+ * like top. Button 2 dumps the accounting of every thread over USB.
+ */
+void thread_load() {
+    static uint64_t last_run[LOAD_VIEW_THREADS];
+    uint32_t used[LOAD_VIEW_THREADS];
+    bool skip[LOAD_VIEW_THREADS];
+    uint64_t last_uptime = 0, window;
+    ThreadStats stats;
+    char line[32];
+    int tid, i, top, shown = DISABLED;
+
+    while (1) {
+        if (load_mode == ENABLED) {
+            mutexLock(&deviceScreenLock, WAIT_FOREVER);
+            if (!shown) {
+                cleanScreen();
+                shown = ENABLED;
+            }
+
+            //the load of all threads, the idle time is what is left
+            sprintf(line, "CPU   THREAD  %3d%%", cpuLoad() / 10);
+            printString(line, 0);
+
+            for (tid = 0; tid < LOAD_VIEW_THREADS; tid++) {
+                skip[tid] = true;
+                if (threadStats(tid, &stats) != 0)
+                    continue;
+                skip[tid] = false;
+
+                //a reused slot starts counting from 0 again
+                if (stats.runCycles < last_run[tid])
+                    last_run[tid] = 0;
+                used[tid] = stats.runCycles - last_run[tid];
+                last_run[tid] = stats.runCycles;
+            }
+            window = stats.uptimeCycles - last_uptime;
+            last_uptime = stats.uptimeCycles;
+
+            //the three busiest threads on the lines left
+            for (i = 1; i < 4; i++) {
+                top = -1;
+                for (tid = 0; tid < LOAD_VIEW_THREADS; tid++) {
+                    if (!skip[tid] && (top < 0 || used[tid] > used[top]))
+                        top = tid;
+                }
+
+                if (top >= 0 && window != 0 && threadStats(top, &stats) == 0) {
+                    skip[top] = true;
+                    sprintf(line, "%3u%%  %-13.13s", (unsigned int) (used[top] * 100ULL / window), stats.name);
+                    printString(line, i);
+                } else {
+                    printString("                   ", i);
+                }
+            }
+            mutexUnlock(&deviceScreenLock);
+
+            if (load_dump) {
+                load_dump = false;
+                dumpThreadStats();
+            }
+        } else {
+            shown = DISABLED;
+            eventWait(&app_modes, APP_LOAD, EVENT_WAIT_ANY, WAIT_FOREVER);
+            continue;
         }
+
+        delay(LOAD_VIEW_PERIOD_MS);
     }
 }
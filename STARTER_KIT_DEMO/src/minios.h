@@ -46,4 +46,48 @@ long int timerRead(void);
 #define STDIO_UART1		203
 #define STDIO_UART2		204
 
+//Threads that can exist at once: the static ones of conf_threads.h, the
+//kernel threads (idle, work queue, timers, trace) and the ones created at
+//run time. Each one is a 96 byte control block, exited ones are reused
+#ifndef MAX_THREADS
+#define MAX_THREADS				12
+#endif
+
+//Thread priorities. 0 is the highest, one bit per level in the ready bitmap
+#define NUM_OF_PRIORITIES		32
+#define PRIORITY_HIGHEST		0
+#define PRIORITY_NORMAL			16
+#define PRIORITY_LOWEST			(NUM_OF_PRIORITIES - 1)
+
+//Threads of equal priority take turns, each running for its time slice
+//unless it blocks or a higher priority thread wakes up. createThread gives
+//one tick; createThreadEx takes the slice in ms, up to QUANTUM_MAX_MS
+#define QUANTUM_MAX_MS			200
+
+//Periodic threads take the priorities right below the kernel threads, by
+//period (rate-monotonic), or by deadline with RT_EDF. One that uses up its
+//budget drops to PRIORITY_RT_THROTTLED until its next release
+#define RT_MAX_TASKS			8
+#define PRIORITY_RT_HIGHEST		1
+#define PRIORITY_RT_THROTTLED	(PRIORITY_LOWEST - 1)
+//#define RT_EDF
+
+//Comment out to keep the periodic tick running while idle
+#define TICKLESS_IDLE
+
+//Uncomment to put an MPU no-access region under the running thread's stack,
+//so an overflow faults right away. Takes 8 words off every stack
+//#define STACK_GUARD
+
+//Uncomment to compile in the kernel cycle-count benchmarks
+//#define SOS_BENCHMARK
+
+//Uncomment to record switches, ticks, SVCs and interrupts and stream them
+//over the USB CDC, see trace.h. The CDC then carries binary frames
+//#define SOS_TRACE
+
+//Uncomment to count and time every syscall in SVC_Switch, for syscallStats
+//and the thread stats dump
+//#define SOS_SYSCALL_STATS
+
 #endif
@@ -8,11 +8,50 @@
 
 
 #include <asf.h>
+#include "sync.h"
 
-typedef struct{
-	char* name;
+//Thread states
+#define THREAD_READY		0	//running or in the ready queue
+#define THREAD_SLEEPING		1	//in the sleep list until its delay expires
+#define THREAD_BLOCKED		2	//waiting for another thread
+#define THREAD_ZOMBIE		3	//exited, waiting to be joined
+#define THREAD_DEAD			4	//exited, reclaimed at the next switch
+
+//Fields are ordered by size so the struct has no padding, with what every
+//switch reads first
+typedef struct Minithread{
 	uint32_t* sp;
-	uint32_t* bp;
-	bool execFirstTime;
-	bool alive;
+	struct Minithread* next;	//next thread in the same ready or sleep list
+	uint8_t priority;			//0 is the highest priority, raised while it holds a mutex
+	uint8_t state;
+	uint8_t quantum;			//ticks in one time slice
+	uint8_t sliceLeft;			//ticks left of the current slice, 0 once used up
+	bool privileged;			//kernel threads run privileged
+	bool alive;					//false once reclaimed
+	bool detached;				//reclaimed on exit, can't be joined
+	uint8_t basePriority;		//priority it was created with
+	uint16_t stackWords;		//size of the stack
+	uint8_t stackClass;			//size class of the stack in the pool, or STACK_STATIC
+	uint8_t waitMode;			//EVENT_WAIT_ALL, EVENT_CLEAR, while waiting for events
+	uint32_t* bp;				//lowest address of the stack
+	char* name;
+	struct RtTask* rt;			//periodic parameters, NULL for other threads
+	uint32_t delta;				//ticks to wake up after the previous sleeper
+	struct Minithread* joiner;	//thread blocked until this one exits
+	
+	//waiting on a kernel object
+	struct Minithread* waitNext;	//next thread waiting on the same object
+	struct Minithread** waitList;	//wait list it is in, NULL if none
+	Mutex* waitMutex;			//mutex it waits for, NULL if none
+	Mutex* heldMutexes;			//contended mutexes it owns
+	uint32_t waitFlags;			//event flags it waits for
+	uint32_t* result;			//stacked r0 of the blocking SVC, set on wake up
+	
+	//cpu accounting, updated at every switch and wake up
+	uint32_t stamp;				//cycle count when it last started running or waiting
+	uint32_t stateTick;			//tick it went to sleep or blocked
+	uint32_t switches;			//times it was switched in
+	uint32_t sleepTicks;		//ticks spent sleeping or blocked
+	uint64_t runCycles;			//cycles spent running
+	uint64_t readyCycles;		//cycles spent in the ready queue
 }Minithread;
\ No newline at end of file
@@ -0,0 +1,62 @@
+/*
+ * Port layer
+ *
+ * What the kernel needs from the cpu: the first frame of a thread, the
+ * privilege it runs with, and the SVC and PendSV handlers that enter the
+ * kernel and switch threads. port_cm4.c is the Cortex-M4 port, the host
+ * port in ../host runs the kernel as a Linux process (SOS_HOST).
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef PORT_H_
+#define PORT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef SOS_HOST
+//Words PendSV_Handler saves on a thread's stack besides the hardware frame:
+//r4-r11, and EXC_RETURN when there is an FPU
+#if (__FPU_USED == 1)
+#define SW_FRAME_WORDS			9
+#define EXC_RETURN_THREAD_PSP	0xFFFFFFFD	//thread mode, psp, basic frame
+#else
+#define SW_FRAME_WORDS			8
+#endif
+
+//Words of the first frame portInitStack builds
+#define PORT_FRAME_WORDS		(SW_FRAME_WORDS + 8)
+#else
+//The context is in a ucontext, portInitStack only leaves the room the
+//frame takes on the board
+#define PORT_FRAME_WORDS		16
+#endif
+
+// Builds the first context of thread tid below top, so that the first
+// switch to it starts entry, and returning from entry ends the thread.
+// Returns the stack pointer to keep for it
+uint32_t* portInitStack(int tid, uint32_t* top, void (*entry)(void));
+
+// Sets the privilege of the thread about to run, from switchContext
+void portSetPrivilege(bool privileged);
+
+// Whether the size bytes at addr are memory a thread may have the kernel
+// write to (RAM), read from (RAM or flash) or run privileged (flash only,
+// so a thread can't get code it wrote run). Checks syscall arguments
+bool portWritable(uint32_t addr, uint32_t size);
+bool portReadable(uint32_t addr, uint32_t size);
+bool portExecutable(uint32_t addr, uint32_t size);
+
+// Holds off context switches, not interrupts: PendSV stays pending until
+// the unlock. The thread must not block in between
+void portLockSwitch(void);
+void portUnlockSwitch(void);
+
+#ifdef SOS_HOST
+// Switches to the first thread, after startScheduler. Never returns
+void hostStart(void);
+#endif
+
+#endif /* PORT_H_ */
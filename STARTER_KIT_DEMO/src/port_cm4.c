@@ -0,0 +1,140 @@
+/*
+ * Cortex-M4 port
+ *
+ * Threads run in thread mode on the psp. An SVC enters the kernel through
+ * SVC_Switch; switches are done in PendSV, the lowest priority exception,
+ * around switchContext.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include "threads.h"
+#include "port.h"
+
+//CONTROL for thread mode: always on the psp, privileged for kernel threads only
+#define CONTROL_KERNEL_THREAD	0x02
+#define CONTROL_USER_THREAD		0x03
+
+void SVC_Switch(unsigned int *);
+uint32_t* switchContext(uint32_t*);
+
+/*
+ * Initially the thread has neither a software nor a hardware context, so
+ * they are inserted here, as PendSV_Handler expects to find them.
+ */
+uint32_t* portInitStack(int tid, uint32_t* top, void (*entry)(void)){
+	uint32_t* sp = top - (SW_FRAME_WORDS + 8);
+	uint32_t* frame = sp;
+	int i;
+	
+	for (i = 0; i < 8; i++)
+		frame[i] = 0; //r4-r11
+	
+	#if (__FPU_USED == 1)
+	frame[8] = EXC_RETURN_THREAD_PSP; //no FPU context until the thread uses it
+	#endif
+	
+	frame += SW_FRAME_WORDS;
+	frame[0] = 0; //r0
+	frame[1] = 0; //r1
+	frame[2] = 0; //r2
+	frame[3] = 0; //r3
+	frame[4] = 0; //r12
+	frame[5] = (uint32_t) exitThread; //lr, so returning from the thread ends it
+	frame[6] = (uint32_t) entry; //pc
+	frame[7] = 0x21000000; //psr
+	
+	return sp;
+}
+
+/*
+ * Takes effect on the exception return.
+ */
+void portSetPrivilege(bool privileged){
+	__set_CONTROL(privileged ? CONTROL_KERNEL_THREAD : CONTROL_USER_THREAD);
+}
+
+//Whether [addr, addr + size) is in [start, start + length), without overflowing
+static bool portInside(uint32_t addr, uint32_t size, uint32_t start, uint32_t length){
+	return addr >= start && addr - start <= length && size <= length - (addr - start);
+}
+
+bool portWritable(uint32_t addr, uint32_t size){
+	return portInside(addr, size, IRAM_ADDR, IRAM_SIZE);
+}
+
+//Both flash planes follow each other
+bool portExecutable(uint32_t addr, uint32_t size){
+	return portInside(addr, size, IFLASH0_ADDR, IFLASH1_ADDR + IFLASH1_SIZE - IFLASH0_ADDR);
+}
+
+bool portReadable(uint32_t addr, uint32_t size){
+	return portWritable(addr, size) || portExecutable(addr, size);
+}
+
+//BASEPRI at the priority of PendSV, the lowest, masks it and nothing else
+void portLockSwitch(void){
+	__set_BASEPRI(((1 << __NVIC_PRIO_BITS) - 1) << (8 - __NVIC_PRIO_BITS));
+}
+
+void portUnlockSwitch(void){
+	__set_BASEPRI(0);
+}
+
+/*  
+ * Copies either the PSP or the MSP address into the stack, then calls
+ * SVC_Switch.
+ */
+void SVC_Handler(void) {
+    asm (
+                "tst lr, #4\t\n" /* Check EXC_RETURN[2] */
+                "ite eq\t\n"
+                "mrseq r0, msp\t\n"
+                "mrsne r0, psp\t\n"
+                "b %[SVC_Switch]\t\n"
+                : /* no output */
+                : [SVC_Switch] "i" (SVC_Switch) /* input */
+                : "r0" /* clobber */
+                );
+}
+
+/*
+ * Lowest priority exception, so it only runs once no other handler is active.
+ * Saves r4-r11 of the outgoing thread on its stack, lets the scheduler pick
+ * the next thread and restores r4-r11 from that thread's stack.
+ *
+ * With an FPU, EXC_RETURN is kept with each thread. Bit 4 clear means the
+ * thread has used the FPU and got an extended frame, whose s0-s15 the
+ * hardware stacks lazily; only then are s16-s31 saved and restored here.
+ * Threads that never touch the FPU pay nothing for it.
+ */
+__attribute__((naked)) void PendSV_Handler(void){
+	asm volatile (
+	"MRS r0, psp\n\t"
+	#if (__FPU_USED == 1)
+	"TST lr, #0x10\n\t"
+	"IT eq\n\t"
+	"VSTMDBEQ r0!, {s16-s31}\n\t"
+	"STMDB r0!, {r4-r11, lr}\n\t"	//EXC_RETURN goes with the thread
+	#else
+	"STMDB r0!, {r4-r11}\n\t"
+	"PUSH {r3, lr}\n\t"			//keep EXC_RETURN (r3 keeps msp 8-byte aligned)
+	#endif
+	"CPSID i\n\t"				//SVCs and ISRs also touch the ready queue
+	"BL switchContext\n\t"
+	"CPSIE i\n\t"
+	#if (__FPU_USED == 1)
+	"LDMIA r0!, {r4-r11, lr}\n\t"
+	"TST lr, #0x10\n\t"
+	"IT eq\n\t"
+	"VLDMIAEQ r0!, {s16-s31}\n\t"
+	#else
+	"POP {r3, lr}\n\t"
+	"LDMIA r0!, {r4-r11}\n\t"
+	#endif
+	"MSR psp, r0\n\t"
+	"BX lr\n\t"
+	);
+}
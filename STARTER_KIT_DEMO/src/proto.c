@@ -0,0 +1,134 @@
+/*
+ * Protothreads
+ *
+ * The dispatcher keeps the running tasks in a list and calls every one
+ * that can go on, then sleeps on its event flags until the next delay
+ * runs out, an event a task waits for is set or a task is started. Starts
+ * come through a multi-producer ring, so threads and interrupt handlers
+ * never touch the list.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include "minios.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "ring.h"
+#include "proto.h"
+
+#define PROTO_STACK_SIZE		256
+#define PROTO_START_SLOTS		8
+
+//above the sensor threads, the tasks only ever run for a moment
+#define PROTO_PRIORITY			(PRIORITY_NORMAL - 1)
+
+//set by protoStart, wakes the dispatcher up to take the new task
+#define PROTO_EVENT_START		0x80000000UL
+
+MPSC_RING_DEFINE(protoStarts, ProtoTask*, PROTO_START_SLOTS);
+static EventFlags protoEvents = EVENT_FLAGS_INIT;
+static ProtoTask* protoTasks = NULL;
+
+/*
+ * Whether t can go on, at kernelMillis now with events set.
+ */
+static bool protoDue(ProtoTask* t, uint32_t now, uint32_t events){
+	switch (t->wait){
+		case PROTO_WAIT_DELAY:
+			return (int32_t) (now - t->wakeMs) >= 0;
+		case PROTO_WAIT_EVENT:
+			return (t->waitMask & events) != 0;
+		default:
+			return true;
+	}
+}
+
+/*
+ * Kernel thread that runs the tasks. Each pass calls the tasks that can go
+ * on, and works out how long it may sleep from the ones that can't.
+ */
+static void protoDispatcher(void){
+	uint32_t events = 0;
+	uint32_t now, mask, timeout;
+	ProtoTask** link;
+	ProtoTask* t;
+
+	while (1){
+		while (ringReceive(&protoStarts, &t, 0) == 0){
+			t->next = protoTasks;
+			protoTasks = t;
+		}
+
+		mask = PROTO_EVENT_START;
+		timeout = WAIT_FOREVER;
+		now = kernelMillis();
+
+		link = &protoTasks;
+		while ((t = *link) != NULL){
+			if (protoDue(t, now, events)){
+				if (t->wait == PROTO_WAIT_EVENT)
+					t->events = t->waitMask & events;
+				t->wait = PROTO_WAIT_NONE;
+				t->state = t->run(t);
+
+				if (t->state == PROTO_EXITED){
+					*link = t->next;
+					continue;
+				}
+			}
+
+			if (t->wait == PROTO_WAIT_DELAY){
+				uint32_t left = ((int32_t) (t->wakeMs - now) > 0) ? t->wakeMs - now : 0;
+				if (left < timeout)
+					timeout = left;
+			} else if (t->wait == PROTO_WAIT_EVENT){
+				mask |= t->waitMask;
+			} else {
+				//it yielded, only look for new events before the next pass
+				timeout = 0;
+			}
+			link = &t->next;
+		}
+
+		events = eventWait(&protoEvents, mask, EVENT_WAIT_ANY | EVENT_CLEAR, timeout);
+	}
+}
+
+/*
+ * Starts the dispatcher thread, along with the scheduler.
+ */
+void protoInit(void){
+	createKernelThread(&protoDispatcher, "proto ", PROTO_STACK_SIZE, PROTO_PRIORITY);
+}
+
+int protoStart(ProtoTask* task){
+	if (task->state != PROTO_EXITED)
+		return -1;
+
+	task->line = 0;
+	task->wait = PROTO_WAIT_NONE;
+	task->state = PROTO_YIELDED;
+	if (!ringSend(&protoStarts, &task)){
+		task->state = PROTO_EXITED;
+		return -1;
+	}
+
+	eventSet(&protoEvents, PROTO_EVENT_START);
+	return 0;
+}
+
+void protoSignal(uint32_t events){
+	eventSet(&protoEvents, events & PROTO_EVENTS);
+}
+
+void protoWaitDelay(ProtoTask* task, uint32_t ms){
+	task->wait = PROTO_WAIT_DELAY;
+	task->wakeMs = kernelMillis() + ms;
+}
+
+void protoWaitEvent(ProtoTask* task, uint32_t mask){
+	task->wait = PROTO_WAIT_EVENT;
+	task->waitMask = mask & PROTO_EVENTS;
+}
@@ -0,0 +1,88 @@
+/*
+ * Protothreads
+ *
+ * Stackless tasks for small jobs, like blinking an LED a few times. A task
+ * is a function that the dispatcher thread calls again every time the task
+ * can go on; the PT_ macros return from it when it has to wait and jump
+ * back to the same place on the next call. All tasks share the stack of
+ * the dispatcher, so a task costs one ProtoTask and a switch between tasks
+ * is a function call.
+ *
+ * Locals don't survive a wait: keep what a task needs across waits in a
+ * struct that starts with its ProtoTask. Don't use switch statements
+ * around the PT_ macros, and don't block in a task (no delay, semWait,
+ * mutexLock...), that holds up every other task. Tasks run in the
+ * dispatcher, a kernel thread, next to the preemptive threads.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef PROTO_H_
+#define PROTO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//What a task function returns
+#define PROTO_YIELDED		0	//run it again on the next pass
+#define PROTO_WAITING		1	//waiting for a delay or events
+#define PROTO_EXITED		2	//done, until it is started again
+
+//Event flags of protoSignal, bit 31 is the dispatcher's own
+#define PROTO_EVENTS		0x7FFFFFFFUL
+
+typedef struct ProtoTask{
+	int (*run)(struct ProtoTask*);
+	char* name;
+	uint16_t line;				//where run goes on, 0 to start over
+	uint8_t state;				//PROTO_ task function return, kept by the dispatcher
+	uint8_t wait;				//what it waits for
+	uint32_t wakeMs;			//kernelMillis to go on at, waiting for a delay
+	uint32_t waitMask;			//events it waits for
+	uint32_t events;			//events that ended the last PT_WAIT_EVENT
+	struct ProtoTask* next;		//next task of the dispatcher
+}ProtoTask;
+
+#define PROTO_TASK_INIT(run, name) { (run), (name), 0, PROTO_EXITED, 0, 0, 0, 0, 0 }
+
+//ProtoTask.wait
+#define PROTO_WAIT_NONE		0
+#define PROTO_WAIT_DELAY	1
+#define PROTO_WAIT_EVENT	2
+
+void protoInit(void);
+
+// Hands task to the dispatcher, it starts from the top on the next pass.
+// Returns 0, or -1 if it is already running or too many starts are queued
+int protoStart( ProtoTask* task );
+
+// Sets events (of PROTO_EVENTS) for the tasks in PT_WAIT_EVENT. One that
+// nobody waits for stays set until a task waits for it. Callable from
+// interrupt handlers
+void protoSignal( uint32_t events );
+
+// Used by the macros below
+void protoWaitDelay( ProtoTask* task, uint32_t ms );
+void protoWaitEvent( ProtoTask* task, uint32_t mask );
+
+#define PT_BEGIN(pt)		switch ((pt)->line) { case 0:
+#define PT_END(pt)			} (pt)->line = 0; return PROTO_EXITED
+
+#define PT_RESUME_HERE(pt, ret)	do { (pt)->line = __LINE__; return (ret); case __LINE__:; } while (0)
+
+// Lets the other tasks run before going on
+#define PT_YIELD(pt)		PT_RESUME_HERE(pt, PROTO_YIELDED)
+
+// Goes on after ms, at the resolution of the kernel tick
+#define PT_DELAY(pt, ms)	do { protoWaitDelay((pt), (ms)); PT_RESUME_HERE(pt, PROTO_WAITING); } while (0)
+
+// Goes on once protoSignal set any of mask, they are in (pt)->events
+#define PT_WAIT_EVENT(pt, mask)	do { protoWaitEvent((pt), (mask)); PT_RESUME_HERE(pt, PROTO_WAITING); } while (0)
+
+// Checks cond once a pass until it holds
+#define PT_WAIT_UNTIL(pt, cond)	do { (pt)->line = __LINE__; case __LINE__: if (!(cond)) return PROTO_YIELDED; } while (0)
+
+#define PT_EXIT(pt)			do { (pt)->line = 0; return PROTO_EXITED; } while (0)
+
+#endif /* PROTO_H_ */
@@ -0,0 +1,110 @@
+/*
+ * Ring buffers
+ *
+ * Positions count up forever, the slot of a position is its low bits.
+ * Producers only move head and the consumer only moves tail, each after
+ * the item has been copied, so neither side ever locks.
+ *
+ * A single producer publishes an item just by moving head past it. With
+ * several producers, head only hands out slots, and an item may be written
+ * after one behind it. Each slot then has its own published word, and the
+ * consumer waits for its slot even if the count already says an item is in.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "scheduler.h"
+#include "ring.h"
+
+/*
+ * Adds one to a word more than one producer may change.
+ */
+static void atomicIncrement(volatile uint32_t* word) {
+    uint32_t value;
+
+    do {
+        value = __LDREXW(word);
+    } while (__STREXW(value + 1, word) != 0);
+}
+
+bool ringSend(Ring* r, const void* item) {
+    uint32_t pos;
+
+    if (r->published == NULL) {
+        pos = r->head;
+        if (pos - r->tail >= r->size) {
+            r->dropped++;
+            return false;
+        }
+    } else {
+        do {
+            pos = __LDREXW(&r->head);
+            if (pos - r->tail >= r->size) {
+                __CLREX();
+                atomicIncrement(&r->dropped);
+                return false;
+            }
+        } while (__STREXW(pos + 1, &r->head) != 0);
+    }
+
+    memcpy(&r->items[(pos & (r->size - 1)) * r->itemSize], item, r->itemSize);
+
+    //the item has to be in memory before the consumer can see it
+    __DMB();
+    if (r->published == NULL)
+        r->head = pos + 1;
+    else
+        r->published[pos & (r->size - 1)] = pos + 1;
+
+    semPost(&r->count);
+    return true;
+}
+
+/*
+ * What is left of timeoutMs since start, in kernelMillis.
+ */
+static uint32_t timeLeft(uint32_t start, uint32_t timeoutMs) {
+    uint32_t waited = kernelMillis() - start;
+
+    if (timeoutMs == WAIT_FOREVER)
+        return WAIT_FOREVER;
+    return (waited < timeoutMs) ? timeoutMs - waited : 0;
+}
+
+int ringReceive(Ring* r, void* item, uint32_t timeoutMs) {
+    uint32_t pos = r->tail;
+    uint32_t start = kernelMillis();
+
+    if (r->credit > 0) {
+        r->credit--;
+    } else if (semWait(&r->count, timeoutMs) != 0) {
+        return -1;
+    }
+
+    //an item behind this one was published first. Its count is taken
+    //now and kept for the next call. All the waits share the one timeout
+    if (r->published != NULL) {
+        while (r->published[pos & (r->size - 1)] != pos + 1) {
+            if (semWait(&r->count, timeLeft(start, timeoutMs)) != 0) {
+                r->credit++;
+                return -1;
+            }
+            r->credit++;
+        }
+    }
+
+    __DMB();
+    memcpy(item, &r->items[(pos & (r->size - 1)) * r->itemSize], r->itemSize);
+
+    //the slot can only be reused once the item is out
+    __DMB();
+    r->tail = pos + 1;
+    return 0;
+}
+
+uint32_t ringCount(Ring* r) {
+    return r->count.count + r->credit;
+}
@@ -0,0 +1,53 @@
+/*
+ * Ring buffers
+ *
+ * Fixed size queues of fixed size items, to hand data from interrupt
+ * handlers or threads to one consuming thread. A ring defined with
+ * RING_DEFINE takes a single producer and never waits to send. One defined
+ * with MPSC_RING_DEFINE takes any number of producers, which claim slots
+ * with LDREX/STREX. Either way a full ring drops the new item, and the
+ * consumer can block until an item arrives.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sync.h"
+
+typedef struct Ring{
+	uint8_t* items;
+	volatile uint32_t* published;	//per slot, position + 1 once written. Multi-producer only
+	uint16_t size;					//slots, a power of two
+	uint16_t itemSize;
+	volatile uint32_t head;			//positions taken by producers
+	volatile uint32_t tail;			//positions given back by the consumer
+	uint32_t credit;				//items counted but not read yet, consumer only
+	volatile uint32_t dropped;		//items lost to a full ring
+	Semaphore count;				//items published
+}Ring;
+
+#define RING_DEFINE(name, type, slots) \
+	static uint32_t name##_items[((slots) * sizeof(type) + 3) / 4]; \
+	Ring name = { (uint8_t*) name##_items, 0, (slots), sizeof(type), 0, 0, 0, 0, SEMAPHORE_INIT(0) }
+
+#define MPSC_RING_DEFINE(name, type, slots) \
+	static uint32_t name##_items[((slots) * sizeof(type) + 3) / 4]; \
+	static volatile uint32_t name##_published[(slots)]; \
+	Ring name = { (uint8_t*) name##_items, name##_published, (slots), sizeof(type), 0, 0, 0, 0, SEMAPHORE_INIT(0) }
+
+// Copies item into the ring. Returns false if it was full. Callable from
+// interrupt handlers
+bool ringSend( Ring* r, const void* item );
+
+// Copies the oldest item out, waiting up to timeoutMs for one. Returns 0,
+// or -1 if the ring stayed empty. From the consuming thread only
+int ringReceive( Ring* r, void* item, uint32_t timeoutMs );
+
+uint32_t ringCount( Ring* r );
+
+#endif /* RING_H_ */
@@ -11,170 +11,1859 @@
 
 #include <asf.h>
 #include "minios.h"
+#include "sysnums.h"
+#include "scheduler.h"
+#include "threads.h"
+#include "workqueue.h"
+#include "timer.h"
+#include "proto.h"
+#include "device.h"
+#include "trace.h"
+#include "port.h"
+#include "conf_threads.h"
 
 #ifndef MINITHREAD_H_
 #define MINITHREAD_H_
 #include "minithread.h"
 #endif
 
-extern uint32_t _estack2;
-extern STACK2_SIZE;
+extern uint32_t _estack2[];
+extern uint32_t _sstack2[];
 
-#define MAX_NUM_OF_THREADS	100 //has to be fixed
-#define QUEUE_SIZE 100
+//Length of a tick and count of ticks since the scheduler started
+#define TICK_US			900
+#define MS_TO_KERNEL_TICKS(ms) (((uint32_t) (ms) * 1000 + TICK_US - 1) / TICK_US)
+static volatile uint32_t kernelTicks = 0;
+
+//id of theCurrentThread, readable by user code
+volatile int currentThreadId = -1;
+
+//Ready queue: one fifo of thread control blocks per priority level, linked
+//through Minithread.next, plus a bitmap with bit (31 - priority) set while
+//that level is non-empty. The highest ready priority is then a single CLZ.
+static Minithread* readyHead[NUM_OF_PRIORITIES];
+static Minithread* readyTail[NUM_OF_PRIORITIES];
+static uint32_t readyBitmap = 0;
+
+#define PRIORITY_BIT(p) (0x80000000UL >> (p))
+
+//Sleeping threads, sorted by wake up time. Each one only keeps the number of
+//ticks after the one before it, so a tick only has to look at the head.
+static Minithread* sleepHead = NULL;
+
+#define IDLE_STACK_SIZE	64
+
+//Periodic threads. Releases are kept as a tick plus the us past it, so
+//periods that aren't whole ticks don't drift. Priorities are handed out
+//again at every start, release and throttle, by period or by deadline
+typedef struct RtTask{
+	Minithread* thread;			//NULL while the slot is free
+	uint32_t periodUs;
+	uint32_t deadlineUs;		//from the release
+	uint32_t budgetCycles;		//0 for no budget
+	uint32_t release;			//tick the current job was released at
+	uint32_t phase;				//us past that tick
+	uint32_t deadline;			//tick the current job is due by
+	uint64_t jobStart;			//runCycles of the thread at the release
+	bool waiting;				//sleeping until the next release
+	bool throttled;				//used up its budget, demoted until the next release
+	bool started;				//got the cpu since the release
+	uint8_t plainPriority;		//base priority from before it was periodic
+	uint32_t jobs;
+	uint32_t deadlineMisses;
+	uint32_t budgetOverruns;
+	uint32_t maxLatency;		//cycles from a release until it ran
+}RtTask;
+
+static RtTask rtTasks[RT_MAX_TASKS];
+
+//Stack pool. Stacks come in a few size classes (in words) carved from the
+//stack2 region. An exited thread's stack goes to the free list of its class
+//and is reused as is, so creating and reclaiming threads is O(1) and runs
+//in constant memory. Free stacks are linked through their first word.
+#define NUM_OF_STACK_CLASSES	4
+static const int stackClassSize[NUM_OF_STACK_CLASSES] = { 64, 128, 256, 512 };
+static uint32_t* freeStacks[NUM_OF_STACK_CLASSES];
+
+//The boot code runs on the top of stack2 (the psp the startup code sets)
+//until the first switch, startScheduler and all it calls included. The
+//pool starts below, rounded down to 32 bytes so every stack starts on an
+//MPU region boundary
+#define BOOT_STACK_WORDS	128
+#define STACK_POOL_TOP		((uint32_t*) (((uintptr_t) _estack2 - BOOT_STACK_WORDS * 4) & ~0x1FUL))
+#define STACK_POOL_WORDS	(STACK_POOL_TOP - _sstack2)
+
+//Unused stack words hold this, so the deepest a thread ever got can be found
+#define STACK_PAINT			0xDEADBEEF
+
+#ifdef STACK_GUARD
+//Lowest words of every stack, no access while the thread runs. MPU regions
+//are numbered by priority, so the guard goes in the last one, over the
+//regions for the memory map
+#define STACK_GUARD_WORDS	8
+#define STACK_GUARD_REGION	7
+
+//Region attributes, as in the default memory map
+#define MPU_RASR_SIZE(log2)		((((log2) - 1) << MPU_RASR_SIZE_Pos) | MPU_RASR_ENABLE_Msk)
+#define MPU_AP_NONE				(0UL << 24)
+#define MPU_AP_FULL				(3UL << 24)
+#define MPU_XN					(1UL << 28)
+#define MPU_NORMAL_WT			(1UL << 17)					//C
+#define MPU_NORMAL_WBWA			((1UL << 19) | (3UL << 16))	//TEX=1, C, B
+#define MPU_SHAREABLE			(1UL << 18)
+#define MPU_DEVICE				((1UL << 16) | MPU_SHAREABLE)	//B
+
+//MemManage fault status
+#define MMFSR_MSTKERR			(1UL << 4)
+#define MMFSR_MLSPERR			(1UL << 5)	//lazy stacking of s0-s15 and FPSCR
+#define MMFSR_MMARVALID			(1UL << 7)
+
+//stack overflows caught by the guard
+uint32_t stackOverflows = 0;
+#else
+#define STACK_GUARD_WORDS	0
+#endif
+
+//Ticks in a time slice of ms, at least one
+#define QUANTUM_TICKS(ms) (MS_TO_KERNEL_TICKS(ms) > 0 ? MS_TO_KERNEL_TICKS(ms) : 1)
+
+//stackClass of the static threads, whose stacks are not from the pool
+#define STACK_STATIC		0xFF
+
+//Static threads, from the table in conf_threads.h. They take the first
+//slots of threads[], and the compiler lays out their control blocks and
+//their stacks, in .bss so they cost no flash and no copy at boot.
+//startScheduler paints the stacks, builds the first frames and links the
+//threads into the ready queue. A static thread that exits gives its slot
+//back, not its stack
+#define STATIC_TID(id, entry, label, words, prio, ms, priv) STATIC_TID_##id,
+enum { STATIC_THREADS(STATIC_TID) NUM_OF_STATIC_THREADS };
+_Static_assert(NUM_OF_STATIC_THREADS < MAX_THREADS, "MAX_THREADS leaves no room for the idle thread");
+
+#define STATIC_STACK(id, entry, label, words, prio, ms, priv) \
+	_Static_assert((words) > PORT_FRAME_WORDS + STACK_GUARD_WORDS, "stack of " #id " too small"); \
+	_Static_assert((prio) <= PRIORITY_LOWEST && (ms) <= QUANTUM_MAX_MS, "bad priority or slice for " #id); \
+	static uint32_t id##Stack[words] __attribute__((aligned(32), section(".bss.stacks")));
+STATIC_THREADS(STATIC_STACK)
+
+#define STATIC_TCB(id, entry, label, words, prio, ms, priv) \
+	[STATIC_TID_##id] = { \
+		.name = label, \
+		.bp = id##Stack, \
+		.stackWords = (words), \
+		.stackClass = STACK_STATIC, \
+		.alive = true, \
+		.privileged = (priv), \
+		.priority = (prio), \
+		.basePriority = (prio), \
+		.quantum = QUANTUM_TICKS(ms), \
+		.state = THREAD_READY, \
+	},
+static Minithread threads[MAX_THREADS] = { STATIC_THREADS(STATIC_TCB) };
+
+#define STATIC_ENTRY(id, entry, label, words, prio, ms, priv) [STATIC_TID_##id] = (void (*)(void)) (entry),
+static void (* const staticEntries[NUM_OF_STATIC_THREADS])(void) = { STATIC_THREADS(STATIC_ENTRY) };
 
-static Minithread threads[MAX_NUM_OF_THREADS];
 static int curThread = 0;
-static int numOfThreads = 0;
+static int numOfThreads = NUM_OF_STATIC_THREADS;
 static int allocatedStack  = 0;
-static bool firstExec = true;
-static Minithread theCurrentThread;
-static Minithread queue[QUEUE_SIZE];
-static int head;
-static int tail;
+static Minithread* freeThreads = NULL;	//reclaimed control blocks
+static Minithread* theCurrentThread = NULL;
+static Minithread* idle = NULL;
+
+#ifdef TICKLESS_IDLE
+//While tickless, sleeps are timed on the RTT counter of the timer service.
+//An RTT count is about a tenth of a tick, so the part of a tick a sleep
+//lasted past its last whole tick is carried over to the next sleep
+static uint32_t ticklessCarryUs = 0;
+//longest sleep when no thread is waiting on a delay
+#define TICKLESS_MAX_TICKS		0xFFFF
+#endif
+
+//Sleep residency: ticks that went by with the idle thread running, and
+//times it came back from a sleep. In periodic mode every tick wakes it up.
+uint32_t idleTicks = 0;
+uint32_t idleWakeups = 0;
+
+//Cpu load: cycles run by the threads other than idle, and by the idle
+//hooks, against the cycles of the ticks that went by. The cycle counter
+//stops while the core sleeps, so the idle time is whatever is left
+#define LOAD_WINDOW_TICKS	MS_TO_KERNEL_TICKS(1000)
+static uint64_t busyCycles = 0;
+static uint64_t loadBusyMark = 0;
+static uint32_t loadTickMark = 0;
+
+//over the last window, in tenths of a percent. Readable by user code
+volatile uint16_t cpuLoadPermille = 0;
+
+//Background work of the idle thread, in the order it was added
+#define IDLE_HOOKS_MAX		4
+static IdleHook idleHooks[IDLE_HOOKS_MAX];
+
+static int newThread(void (*)(void), char*, int, uint8_t, uint8_t, bool);
+static void loadUpdate(void);
+static void reapThread(Minithread*);
+static void stackPaint(uint32_t*, uint32_t*);
+static void waitAbort(Minithread*);
+static void rtRelease(Minithread*);
+static void rtBudgetTick(Minithread*);
+static void rtRemove(Minithread*);
+
+/*
+ * Appends a thread to the tail of the ready list of its priority.
+ */
+static inline void readyEnqueue(Minithread* t){
+	uint8_t p = t->priority;
+	
+	t->next = NULL;
+	if (readyHead[p] == NULL){
+		readyHead[p] = t;
+		readyBitmap |= PRIORITY_BIT(p);
+	} else {
+		readyTail[p]->next = t;
+	}
+	readyTail[p] = t;
+}
+
+/*
+ * Puts a thread back at the head of the ready list of its priority, for one
+ * that was preempted before its time slice ran out.
+ */
+static inline void readyPush(Minithread* t){
+	uint8_t p = t->priority;
+	
+	t->next = readyHead[p];
+	if (readyHead[p] == NULL){
+		readyTail[p] = t;
+		readyBitmap |= PRIORITY_BIT(p);
+	}
+	readyHead[p] = t;
+}
+
+/*
+ * Pends a switch if t should preempt the running thread.
+ */
+static inline void preemptFor(Minithread* t){
+	if (theCurrentThread != NULL && t->priority < theCurrentThread->priority)
+		requestContextSwitch();
+}
+
+/*
+ * Removes and returns the first thread of the highest non-empty priority,
+ * or NULL if no thread is ready.
+ */
+static inline Minithread* readyDequeue(void){
+	if (readyBitmap == 0)
+		return NULL;
+	
+	uint8_t p = __CLZ(readyBitmap);
+	Minithread* t = readyHead[p];
+	
+	readyHead[p] = t->next;
+	if (readyHead[p] == NULL)
+		readyBitmap &= ~PRIORITY_BIT(p);
+	t->next = NULL;
+	return t;
+}
+
+/*
+ * Takes a thread out of the middle of the ready list of its priority.
+ */
+static void readyRemove(Minithread* t){
+	uint8_t p = t->priority;
+	Minithread** link = &readyHead[p];
+	Minithread* prev = NULL;
+	
+	while (*link != NULL && *link != t){
+		prev = *link;
+		link = &(*link)->next;
+	}
+	if (*link == NULL)
+		return;
+	
+	*link = t->next;
+	if (readyTail[p] == t)
+		readyTail[p] = prev;
+	if (readyHead[p] == NULL)
+		readyBitmap &= ~PRIORITY_BIT(p);
+	t->next = NULL;
+}
+
+/*
+ * Moves a sleeping or blocked thread back to the ready queue, closing its
+ * sleep interval and opening a ready one.
+ */
+static void wakeThread(Minithread* t){
+	//a periodic thread waiting for its next release
+	if (t->rt != NULL && t->rt->waiting)
+		rtRelease(t);
+	
+	TRACE(TRACE_WAKE, t - threads);
+	t->sleepTicks += kernelTicks - t->stateTick;
+	t->stamp = cpu_cycle_counter_read();
+	t->state = THREAD_READY;
+	readyEnqueue(t);
+	preemptFor(t);
+}
+
+/*
+ * Inserts a thread in the sleep list so that it wakes up in the given
+ * number of ticks (at least 1).
+ */
+static void sleepInsert(Minithread* t, uint32_t ticks){
+	Minithread** link = &sleepHead;
+	
+	while (*link != NULL && (*link)->delta <= ticks){
+		ticks -= (*link)->delta;
+		link = &(*link)->next;
+	}
+	
+	t->delta = ticks;
+	t->next = *link;
+	if (*link != NULL)
+		(*link)->delta -= ticks;
+	*link = t;
+}
+
+/*
+ * Takes a thread out of the sleep list before its delay expired, if it
+ * is in there, handing its remaining ticks to the one after it.
+ */
+static void sleepRemove(Minithread* t){
+	Minithread** link = &sleepHead;
+	
+	while (*link != NULL && *link != t)
+		link = &(*link)->next;
+	if (*link == NULL)
+		return;
+	
+	*link = t->next;
+	if (t->next != NULL)
+		t->next->delta += t->delta;
+	t->next = NULL;
+}
+
+/*
+ * Advances the sleep list by the given number of ticks, moving every thread
+ * whose delay expired back to the ready queue. A thread waiting on an
+ * object with a timeout stops waiting, with the timeout as its result.
+ */
+static void sleepAdvance(uint32_t ticks){
+	while (sleepHead != NULL && ticks > 0){
+		if (sleepHead->delta > ticks){
+			sleepHead->delta -= ticks;
+			return;
+		}
+		
+		ticks -= sleepHead->delta;
+		sleepHead->delta = 0;
+		while (sleepHead != NULL && sleepHead->delta == 0){
+			Minithread* t = sleepHead;
+			
+			sleepHead = t->next;
+			if (t->waitList != NULL)
+				waitAbort(t);
+			wakeThread(t);
+		}
+	}
+}
+
+/*
+ * Blocks the running thread for at least ms milliseconds. The switch happens
+ * as soon as the calling SVC returns.
+ */
+void sleepCurrentThread(uint32_t ms){
+	//nothing to block before the scheduler runs
+	if (theCurrentThread == NULL){
+		delay_ms(ms);
+		return;
+	}
+	
+	if (ms > 0){
+		irqflags_t flags = cpu_irq_save();
+		theCurrentThread->state = THREAD_SLEEPING;
+		theCurrentThread->stateTick = kernelTicks;
+		sleepInsert(theCurrentThread, MS_TO_KERNEL_TICKS(ms));
+		cpu_irq_restore(flags);
+	} else {
+		yieldCurrentThread();
+		return;
+	}
+	
+	requestContextSwitch();
+}
+
+/*
+ * Gives up the rest of the time slice to the next thread of equal priority.
+ */
+void yieldCurrentThread(void){
+	if (theCurrentThread != NULL)
+		theCurrentThread->sliceLeft = 0;
+	requestContextSwitch();
+}
+
+#ifdef TICKLESS_IDLE
+
+/*
+ * Stops SysTick and sleeps on an RTT alarm for up to the given number of
+ * ticks, less the carried over part of one, then accounts for the ticks
+ * that went by and restarts SysTick. SysTick keeps its count while
+ * stopped, so the tick that was on its way still comes, on time.
+ * Called with interrupts disabled; any interrupt still ends the sleep early.
+ */
+static void ticklessSleep(uint32_t ticks, enum sleepmgr_mode mode){
+	uint32_t start = rttNow();
+	uint32_t elapsed, us;
+	
+	SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+	
+	//the alarm goes off for the wake up or the first software timer,
+	//whichever comes first. Rounded up, so a full sleep always covers
+	//its ticks
+	rttArm(start + US_TO_RTT_UP(ticks * TICK_US - ticklessCarryUs));
+	
+	if (mode >= SLEEPMGR_WAIT){
+		//only fast startup inputs can end wait mode
+		pmc_set_fast_startup_input(PMC_FSMR_RTTAL);
+		sleepmgr_sleep(mode);
+		cpu_irq_disable();
+	} else {
+		//interrupts stay masked, so none can slip in between the
+		//checks and the WFI. A pending one still wakes the core
+		__DSB();
+		__WFI();
+	}
+	
+	us = RTT_TO_US(rttNow() - start) + ticklessCarryUs;
+	elapsed = us / TICK_US;
+	ticklessCarryUs = us % TICK_US;
+	if (elapsed > ticks){
+		us -= ticks * TICK_US;
+		elapsed = ticks;
+		ticklessCarryUs = (us < TICK_US) ? us : TICK_US - 1;
+	}
+	
+	//back to the alarm of the first timer. If one came due, the pending
+	//RTT interrupt is taken once interrupts are enabled again
+	timerRearm();
+	
+	kernelTicks += elapsed;
+	idleTicks += elapsed;
+	sleepAdvance(elapsed);
+	loadUpdate();
+	
+	SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+}
+
+#endif
+
+/*
+ * Puts the cpu to sleep in the deepest mode the sleep manager allows until
+ * something has to run. In tickless mode the periodic tick is stopped while
+ * the earliest delay is far enough away.
+ */
+static void idleSleep(void){
+	enum sleepmgr_mode mode;
+	
+	cpu_irq_disable();
+	
+	//a thread woke up since the idle thread got the cpu
+	if (readyBitmap != 0){
+		cpu_irq_enable();
+		requestContextSwitch();
+		return;
+	}
+	
+	mode = sleepmgr_get_sleep_mode();
+	if (mode == SLEEPMGR_ACTIVE){
+		cpu_irq_enable();
+		return;
+	}
+	
+	idleWakeups++;
+	
+	#ifdef TICKLESS_IDLE
+	//the next tick is already on its way, so sleeping through all but
+	//the last tick before the earliest wake up is still on time
+	uint32_t ticks = (sleepHead != NULL) ? sleepHead->delta - 1 : TICKLESS_MAX_TICKS;
+	if (ticks > TICKLESS_MAX_TICKS)
+		ticks = TICKLESS_MAX_TICKS;
+	
+	//a sleep shorter than a tick isn't worth stopping SysTick for, the
+	//plain WFI below ends with the tick
+	if (ticks > 0 && ticks * TICK_US - ticklessCarryUs >= TICK_US){
+		ticklessSleep(ticks, mode);
+		cpu_irq_enable();
+		return;
+	}
+	#endif
+	
+	if (mode >= SLEEPMGR_WAIT){
+		//without the RTT alarm nothing would end wait mode
+		mode = SLEEPMGR_SLEEP_WFI;
+	}
+	
+	//enables interrupts and waits for the next one
+	sleepmgr_sleep(mode);
+}
+
+/*
+ * Runs when nothing else is ready. Kernel thread, so it can stop the
+ * tick and put the cpu to sleep. The idle hooks go first, the cpu only
+ * sleeps once none of them has more to do; their time counts as load.
+ */
+static void idleThread(void){
+	irqflags_t flags;
+	uint32_t start;
+	bool more;
+	int i;
+	
+	while (1){
+		more = false;
+		start = cpu_cycle_counter_read();
+		for (i = 0; i < IDLE_HOOKS_MAX && idleHooks[i] != NULL; i++)
+			more |= idleHooks[i]();
+		
+		if (i > 0){
+			flags = cpu_irq_save();
+			busyCycles += cpu_cycles_since(start);
+			cpu_irq_restore(flags);
+		}
+		
+		if (!more)
+			idleSleep();
+	}
+}
+
+/*
+ * Adds a hook to the idle thread. Returns 0, or -1 if all IDLE_HOOKS_MAX
+ * slots are taken.
+ */
+int addIdleHook(IdleHook hook){
+	irqflags_t flags = cpu_irq_save();
+	int i;
+	
+	for (i = 0; i < IDLE_HOOKS_MAX; i++){
+		if (idleHooks[i] == NULL){
+			idleHooks[i] = hook;
+			cpu_irq_restore(flags);
+			return 0;
+		}
+	}
+	
+	cpu_irq_restore(flags);
+	return -1;
+}
+
+/*
+ * Works out cpuLoadPermille once a window of ticks went by. Called with
+ * interrupts disabled, after kernelTicks moved on.
+ */
+static void loadUpdate(void){
+	uint32_t ticks = kernelTicks - loadTickMark;
+	uint64_t busy, window;
+	
+	if (ticks < LOAD_WINDOW_TICKS)
+		return;
+	
+	//with the interval the current thread is in, which is only added to
+	//busyCycles when it is switched out
+	busy = busyCycles;
+	if (theCurrentThread != NULL && theCurrentThread != idle)
+		busy += cpu_cycles_since(theCurrentThread->stamp);
+	
+	window = (uint64_t) ticks * (SysTick->LOAD + 1);
+	cpuLoadPermille = (busy - loadBusyMark >= window) ? 1000 : (busy - loadBusyMark) * 1000 / window;
+	
+	loadBusyMark = busy;
+	loadTickMark = kernelTicks;
+}
 
 void scheduler(void){
+	Minithread* old = theCurrentThread;
+	
 	//this will not execute on first call of scheduler.
-	if (theCurrentThread.name != NULL){
-		//enqueue old thread.
-		queue[tail] = theCurrentThread;
-		tail = (tail + 1) % QUEUE_SIZE;
+	if (old != NULL && old->alive && old->state == THREAD_READY){
+		//preempted with some of its slice left, it stays first in line
+		//at its priority. Otherwise it goes after its equals
+		if (old->sliceLeft > 0)
+			readyPush(old);
+		else
+			readyEnqueue(old);
+	} else if (old != NULL){
+		//gets a whole slice once it is ready again
+		old->sliceLeft = 0;
 	}
 	
-	//dequeue new thread.
-	theCurrentThread = queue[head];
-	head = (head + 1) % QUEUE_SIZE;
+	//dequeue new thread, keeping the old one if nothing else is ready.
+	Minithread* next = readyDequeue();
+	if (next != NULL)
+		theCurrentThread = next;
+	
+	if (theCurrentThread != NULL && theCurrentThread->sliceLeft == 0)
+		theCurrentThread->sliceLeft = theCurrentThread->quantum;
 }
 
+#ifdef SOS_BENCHMARK
+
+#define BENCH_ROUNDS 1000
+
+#ifdef SOS_TRACE
+//average cycles to record one trace event
+uint32_t benchTraceCycles;
+#endif
+
+//average cycles to rotate one thread through the ready queue
+uint32_t benchFifoCycles;
+uint32_t benchBitmapCycles;
+
+//worst case cycles spent in SysTick_Handler, and from a switch
+//being requested until the next thread's stack pointer is known
+uint32_t benchTickHandlerCycles;
+uint32_t benchSwitchLatency;
+static uint32_t benchPendStamp;
+
+//worst case cycles switchContext spends on cpu accounting
+uint32_t benchAccountCycles;
+
+#if (__FPU_USED == 1)
+//switches away from threads with and without FPU context: how many,
+//and the total cycles from the request until the next thread is known
+uint32_t benchFpSwitches, benchFpSwitchCycles;
+uint32_t benchIntSwitches, benchIntSwitchCycles;
+
+/*
+ * Background load for the switch benchmark, one thread that keeps the FPU
+ * busy and one that never touches it.
+ */
+static void benchFpThread(void){
+	volatile float x = 1.0f;
+	while (1)
+		x = x * 1.0001f + 0.5f;
+}
+
+static void benchIntThread(void){
+	volatile uint32_t x = 1;
+	while (1)
+		x = x * 3 + 1;
+}
+#endif
+
+#define BENCH_MUTEX_ROUNDS 100
+
+//average cycles for a lock and unlock of a free mutex, which never enters
+//the kernel, and for a lock that waits until the owner gives it back: two
+//SVCs and two switches
+uint32_t benchMutexFastCycles;
+uint32_t benchMutexContendedCycles;
+static Mutex benchMutex = MUTEX_INIT;
+static volatile bool benchMutexDone = false;
+
+/*
+ * Kernel thread at the highest priority, so it can read the cycle counter.
+ * Times free lock and unlock pairs first. Then each round it sleeps, which
+ * lets benchMutexOwner take the mutex, and times its own lock as it waits.
+ * It only uses the syscalls, as the application threads do.
+ */
+static void benchMutexWaiter(void){
+	uint32_t start, total = 0;
+	int i;
+	
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++){
+		mutexLock(&benchMutex, WAIT_FOREVER);
+		mutexUnlock(&benchMutex);
+	}
+	benchMutexFastCycles = cpu_cycles_since(start) / BENCH_ROUNDS;
+	
+	for (i = 0; i < BENCH_MUTEX_ROUNDS; i++){
+		svc_r0(SYSCALL_DELAY, 1);
+		start = cpu_cycle_counter_read();
+		mutexLock(&benchMutex, WAIT_FOREVER);
+		total += cpu_cycles_since(start);
+		mutexUnlock(&benchMutex);
+	}
+	benchMutexContendedCycles = total / BENCH_MUTEX_ROUNDS;
+	benchMutexDone = true;
+}
+
+/*
+ * Holds the mutex until benchMutexWaiter waits for it.
+ */
+static void benchMutexOwner(void){
+	while (!benchMutexDone){
+		mutexLock(&benchMutex, WAIT_FOREVER);
+		while (!(benchMutex.lock & MUTEX_CONTENDED) && !benchMutexDone);
+		mutexUnlock(&benchMutex);
+	}
+}
+
+/*
+ * Times one scheduling decision with the old ready queue, which copied whole
+ * Minithread structs in and out of an array of them, against the bitmap
+ * queue. Must run with the scheduler stopped (before SysTick is started).
+ */
+static void schedulerBenchmark(void){
+	//static, the boot stack only has room for a few locals
+	static Minithread fifo[MAX_THREADS];
+	static Minithread current;
+	int fifoHead = 0, fifoTail = 0;
+	uint32_t start;
+	int i;
+	
+	cpu_cycle_counter_init();
+	
+	current = threads[0];
+	for (i = 1; i < numOfThreads; i++){
+		fifo[fifoTail] = threads[i];
+		fifoTail = (fifoTail + 1) % MAX_THREADS;
+	}
+	
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++){
+		fifo[fifoTail] = current;
+		fifoTail = (fifoTail + 1) % MAX_THREADS;
+		current = fifo[fifoHead];
+		fifoHead = (fifoHead + 1) % MAX_THREADS;
+	}
+	benchFifoCycles = cpu_cycles_since(start) / BENCH_ROUNDS;
+	
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++){
+		readyEnqueue(readyDequeue());
+	}
+	benchBitmapCycles = cpu_cycles_since(start) / BENCH_ROUNDS;
+	
+	#ifdef SOS_TRACE
+	start = cpu_cycle_counter_read();
+	for (i = 0; i < BENCH_ROUNDS; i++){
+		TRACE(TRACE_MARK, i);
+	}
+	benchTraceCycles = cpu_cycles_since(start) / BENCH_ROUNDS;
+	
+	//the stream starts with the real events
+	traceHead = 0;
+	#endif
+}
+
+#endif
+
+#ifdef STACK_GUARD
+
+/*
+ * Sets up the MPU. Three regions give code, sram and peripherals the
+ * attributes of the default memory map (which only covers privileged code),
+ * and a no-access region is moved under the stack of each thread that gets
+ * the cpu. Sram stays executable for the ASF functions that run from it.
+ */
+static void stackGuardInit(void){
+	MPU->RBAR = 0x00000000 | MPU_RBAR_VALID_Msk | 0;
+	MPU->RASR = MPU_AP_FULL | MPU_NORMAL_WT | MPU_RASR_SIZE(29);
+	MPU->RBAR = 0x20000000 | MPU_RBAR_VALID_Msk | 1;
+	MPU->RASR = MPU_AP_FULL | MPU_NORMAL_WBWA | MPU_RASR_SIZE(29);
+	MPU->RBAR = 0x40000000 | MPU_RBAR_VALID_Msk | 2;
+	MPU->RASR = MPU_AP_FULL | MPU_DEVICE | MPU_XN | MPU_RASR_SIZE(29);
+	
+	//the base address is set on every switch
+	MPU->RBAR = (uint32_t) STACK_POOL_TOP | MPU_RBAR_VALID_Msk | STACK_GUARD_REGION;
+	MPU->RASR = MPU_AP_NONE | MPU_NORMAL_WBWA | MPU_XN | MPU_RASR_SIZE(5);
+	
+	MPU->CTRL = MPU_CTRL_ENABLE_Msk | MPU_CTRL_PRIVDEFENA_Msk;
+	SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk;
+	__DSB();
+	__ISB();
+}
+
+//Words the hardware stacks on exception entry: the basic frame, or with
+//EXC_RETURN bit 4 clear the extended one with s0-s15, FPSCR and a spare
+#define HW_FRAME_WORDS(excReturn)	(((excReturn) & 0x10) ? 8 : 26)
+
+/*
+ * A thread hit the guard under its stack: either it wrote there itself or
+ * the hardware could not stack an exception frame. The thread is ended and
+ * the switch away from it runs on the top of its stack, its context is
+ * lost anyway. Any other MemManage fault, or one in a handler, is fatal.
+ */
+static __attribute__((used)) void stackFault(uint32_t excReturn){
+	uint32_t mmfsr = SCB->CFSR & SCB_CFSR_MEMFAULTSR_Msk;
+	Minithread* t = theCurrentThread;
+	bool overflow = false;
+	
+	if (t != NULL && (SCB->ICSR & SCB_ICSR_RETTOBASE_Msk)){
+		if (mmfsr & (MMFSR_MSTKERR | MMFSR_MLSPERR))
+			overflow = true;
+		else if ((mmfsr & MMFSR_MMARVALID) && SCB->MMFAR - (uint32_t) t->bp < STACK_GUARD_WORDS * 4)
+			overflow = true;
+	}
+	
+	if (!overflow){
+		while (1);
+	}
+	
+	SCB->CFSR = mmfsr;	//write one to clear
+	stackOverflows++;
+	
+	//room for the frame the fault was stacked as, PendSV saves the rest
+	//of the context below it before the thread is reaped
+	__set_PSP((uint32_t) (t->bp + t->stackWords - HW_FRAME_WORDS(excReturn)));
+	
+	//a kernel thread may have faulted with interrupts off
+	cpu_irq_enable();
+	exitCurrentThread();
+}
+
+/*
+ * Hands EXC_RETURN to stackFault, which needs the size of the frame.
+ */
+__attribute__((naked)) void MemManage_Handler(void){
+	asm volatile (
+	"MOV r0, lr\n\t"
+	"B %[stackFault]\n\t"
+	: : [stackFault] "i" (stackFault) : "r0"
+	);
+}
+
+#endif
+
 void startScheduler(){
 	
+	int i;
+	
 	curThread = 0;
 	
+	//cpu accounting runs on the cycle counter
+	cpu_cycle_counter_init();
+	
+	//the static threads get their first frame and are ready to run
+	for (i = 0; i < NUM_OF_STATIC_THREADS; i++){
+		threads[i].sp = portInitStack(i, threads[i].bp + threads[i].stackWords, staticEntries[i]);
+		stackPaint(threads[i].bp, threads[i].sp);
+		threads[i].stamp = cpu_cycle_counter_read();
+		readyEnqueue(&threads[i]);
+	}
+	
+	#ifdef STACK_GUARD
+	stackGuardInit();
+	#endif
+	
+	//lowest priority, so it only gets the cpu when every other thread sleeps
+	idle = &threads[newThread(&idleThread, "idle ", IDLE_STACK_SIZE, PRIORITY_LOWEST, 1, true)];
+	
+	workQueueInit();
+	timerServiceInit();
+	protoInit();
+	deviceInit();
+	
+	#ifdef SOS_TRACE
+	traceInit();
+	#endif
+	
+	#ifdef SOS_BENCHMARK
+	schedulerBenchmark();
+	int tid = newThread(&benchMutexWaiter, "bench_mutex ", 128, PRIORITY_HIGHEST, 1, true);
+	if (tid >= 0)
+		threads[tid].detached = true;
+	tid = newThread(&benchMutexOwner, "bench_owner ", 128, PRIORITY_HIGHEST + 1, 1, true);
+	if (tid >= 0)
+		threads[tid].detached = true;
+	#if (__FPU_USED == 1)
+	newThread(&benchFpThread, "bench_fp ", 128, PRIORITY_LOWEST - 1, 1, false);
+	newThread(&benchIntThread, "bench_int ", 128, PRIORITY_LOWEST - 1, 1, false);
+	#endif
+	#endif
+	
 	#define MS_TO_TICKS(x) (sysclk_get_cpu_hz()/1000)*(x)
 	#define US_TO_TICKS(x) (sysclk_get_cpu_hz()/1000000)*(x)
-	SysTick_Config( US_TO_TICKS(900) );
+	SysTick_Config( US_TO_TICKS(TICK_US) );
+	
+	#if (__FPU_USED == 1)
+	//full access to the FPU, and lazy stacking of s0-s15 for the
+	//threads that used it (the hardware only reserves the space)
+	SCB->CPACR |= (0xFUL << 20);
+	FPU->FPCCR |= FPU_FPCCR_ASPEN_Msk | FPU_FPCCR_LSPEN_Msk;
+	#endif
+	
+	//PendSV must not preempt any other handler
+	NVIC_SetPriority(PendSV_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+	NVIC_SetPriority(SysTick_IRQn, (1 << __NVIC_PRIO_BITS) - 2);
 }
 
-//Taken verbatim
-static inline void save_context(void){
-	uint32_t scratch;
-	asm volatile ("MRS %0, psp\n\t"
-	"STMDB %0!, {r4-r11}\n\t"
-	"MSR psp, %0\n\t"  : "=r" (scratch) );
+void SysTick_Handler(void){
+	#ifdef SOS_BENCHMARK
+	uint32_t entry = cpu_cycle_counter_read();
+	#endif
+	
+	kernelTicks++;
+	TRACE(TRACE_TICK, kernelTicks);
+	if (theCurrentThread == idle)
+		idleTicks++;
+	
+	//wake up the threads whose delay expired
+	irqflags_t flags = cpu_irq_save();
+	sleepAdvance(1);
+	loadUpdate();
+	cpu_irq_restore(flags);
+	
+	//round robin once the time slice runs out; a thread that woke up
+	//with a higher priority already asked for its switch. The switch
+	//itself is done in PendSV, once every other interrupt has been served
+	if (theCurrentThread != NULL){
+		flags = cpu_irq_save();
+		rtBudgetTick(theCurrentThread);
+		cpu_irq_restore(flags);
+	}
+	
+	if (theCurrentThread != NULL && theCurrentThread->sliceLeft > 0)
+		theCurrentThread->sliceLeft--;
+	if (theCurrentThread == NULL || theCurrentThread->sliceLeft == 0)
+		requestContextSwitch();
+	
+	#ifdef SOS_BENCHMARK
+	uint32_t cycles = cpu_cycles_since(entry);
+	if (cycles > benchTickHandlerCycles)
+		benchTickHandlerCycles = cycles;
+	#endif
 }
 
-//Taken verbatim
-static inline void load_context(void){
-	uint32_t scratch;
-	asm volatile ("MRS %0, psp\n\t"
-	"LDMFD %0!, {r4-r11}\n\t"
-	"MSR psp, %0\n\t"  : "=r" (scratch) );
+/*
+ * Time since the scheduler started, in ms.
+ */
+uint32_t kernelMillis(void){
+	return (uint32_t) (((uint64_t) kernelTicks * TICK_US) / 1000);
 }
 
-void SysTick_Handler(void){
-		//-----------------------------------
-		// CONTEXT SWITCHING HAPPENS HERE
-		//-------------------------------------
-
-		//save software context
-		save_context(); //The first time (as in firstExec) it will save context in some unknown place in psp
-						//but this will be ignored, so doesnt matter... ok its not unknown, it's in the msp
-						//but the next instruction, when firstExec is true,  is load_context() so it's fine.
-					
-		if( firstExec){ //the first ever executed thread wasn't running yet
-			load_context();
-			//so cant get it's sp from psp	
-			firstExec = false;
-			
-			//change current thread
-			scheduler();
-			
-			theCurrentThread.execFirstTime = false;
-			__set_PSP( theCurrentThread.sp );
-			
+/*
+ * Pends a context switch. Safe to call from SVCs and any interrupt handler,
+ * the switch happens when PendSV tail-chains after the last active handler.
+ * In thread mode, with interrupts on, it happens before this returns.
+ */
+void requestContextSwitch(void){
+	#ifdef SOS_BENCHMARK
+	if (!(SCB->ICSR & SCB_ICSR_PENDSVSET_Msk))
+		benchPendStamp = cpu_cycle_counter_read();
+	#endif
+	
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+	__DSB();
+	__ISB();
+}
+
+/*
+ * Called from PendSV with the stack pointer of the outgoing thread, after its
+ * software context has been pushed. Returns the stack pointer of the
+ * incoming thread.
+ */
+uint32_t* switchContext(uint32_t* sp){
+	Minithread* old = theCurrentThread;
+	uint32_t now = cpu_cycle_counter_read();
+	
+	//the first switch comes from the boot code, whose context is dropped
+	if (old != NULL){
+		old->sp = sp;
+		old->runCycles += now - old->stamp;
+		if (old != idle)
+			busyCycles += now - old->stamp;
+		old->stamp = now;
+	}
+	
+	#ifdef SOS_BENCHMARK
+	uint32_t accounting = cpu_cycles_since(now);
+	#endif
+	
+	//change current thread
+	scheduler();
+	
+	#ifdef SOS_BENCHMARK
+	uint32_t accountStart = cpu_cycle_counter_read();
+	#endif
+	
+	//the incoming thread was waiting in the ready queue since its stamp
+	if (theCurrentThread != old){
+		TRACE(TRACE_SWITCH, theCurrentThread - threads);
+		
+		//first run of a periodic job, released when it woke up
+		RtTask* rt = theCurrentThread->rt;
+		if (rt != NULL && !rt->started){
+			rt->started = true;
+			if (now - theCurrentThread->stamp > rt->maxLatency)
+				rt->maxLatency = now - theCurrentThread->stamp;
+		}
+		
+		theCurrentThread->readyCycles += now - theCurrentThread->stamp;
+		theCurrentThread->stamp = now;
+		theCurrentThread->switches++;
+		currentThreadId = theCurrentThread - threads;
+	}
+	
+	#ifdef SOS_BENCHMARK
+	accounting += cpu_cycles_since(accountStart);
+	if (accounting > benchAccountCycles)
+		benchAccountCycles = accounting;
+	#endif
+	
+	#ifdef STACK_GUARD
+	//the guard follows the incoming thread, and leaves the stack of an
+	//exited thread before it is put on the free list
+	MPU->RBAR = (uint32_t) theCurrentThread->bp | MPU_RBAR_VALID_Msk | STACK_GUARD_REGION;
+	__DSB();
+	#endif
+	
+	//an exited thread can give its stack back now that it is off it
+	if (old != NULL && old->state == THREAD_DEAD)
+		reapThread(old);
+	
+	//takes effect on the exception return
+	portSetPrivilege(theCurrentThread->privileged);
+	
+	#ifdef SOS_BENCHMARK
+	uint32_t cycles = cpu_cycles_since(benchPendStamp);
+	if (cycles > benchSwitchLatency)
+		benchSwitchLatency = cycles;
+	
+	#if (__FPU_USED == 1)
+	//sp[8] is the saved EXC_RETURN, bit 4 clear for an FP frame
+	if (old != NULL && !(sp[8] & 0x10)){
+		benchFpSwitches++;
+		benchFpSwitchCycles += cycles;
+	} else {
+		benchIntSwitches++;
+		benchIntSwitchCycles += cycles;
+	}
+	#endif
+	#endif
+	
+	return theCurrentThread->sp;
+}
+
+
+
+
+/*
+ * Takes a stack of at least size words from the pool. Returns its lowest
+ * address and stores its size class in *cls, or returns NULL if the stack
+ * region is exhausted or size is bigger than the largest class.
+ */
+static uint32_t* stackAlloc(int size, uint8_t* cls){
+	uint8_t c;
+	uint32_t* stack;
+	
+	for (c = 0; c < NUM_OF_STACK_CLASSES; c++){
+		if (size <= stackClassSize[c])
+			break;
+	}
+	if (c == NUM_OF_STACK_CLASSES)
+		return NULL;
+	
+	*cls = c;
+	
+	//reuse a stack freed by a thread of the same class
+	if (freeStacks[c] != NULL){
+		stack = freeStacks[c];
+		freeStacks[c] = (uint32_t*) (uintptr_t) stack[0];
+		return stack;
+	}
+	
+	//or carve a new one under the ones already handed out
+	if (allocatedStack + stackClassSize[c] > STACK_POOL_WORDS)
+		return NULL;
+	allocatedStack += stackClassSize[c];
+	return STACK_POOL_TOP - allocatedStack;
+}
+
+/*
+ * Gives a stack back to the free list of its class.
+ */
+static void stackFree(uint32_t* stack, uint8_t cls){
+	stack[0] = (uint32_t) (uintptr_t) freeStacks[cls];
+	freeStacks[cls] = stack;
+}
+
+/*
+ * Paints the stack at bp from over the guard up to sp, the part a new
+ * thread hasn't used yet, for stackPeak.
+ */
+static void stackPaint(uint32_t* bp, uint32_t* sp){
+	uint32_t* p;
+	
+	for (p = bp + STACK_GUARD_WORDS; p < sp; p++)
+		*p = STACK_PAINT;
+}
+
+/*
+ * Deepest the stack of t ever got, in words: everything above the first
+ * word over the guard that still holds the paint.
+ */
+static uint32_t stackPeak(Minithread* t){
+	uint32_t* top = t->bp + t->stackWords;
+	uint32_t* p = t->bp + STACK_GUARD_WORDS;
+	
+	while (p < top && *p == STACK_PAINT)
+		p++;
+	return top - p;
+}
+
+/*
+ * Returns the stack and the control block of a thread that has exited and
+ * is not running anymore.
+ */
+static void reapThread(Minithread* t){
+	if (t->stackClass != STACK_STATIC)
+		stackFree(t->bp, t->stackClass);
+	t->alive = false;
+	t->next = freeThreads;
+	freeThreads = t;
+}
+
+/*
+ * Ends the running thread. A joining thread is woken up, otherwise the
+ * thread stays a zombie until joined, unless it was detached. Its stack is
+ * reclaimed after the switch away from it, it can't be freed while in use.
+ * Contended mutexes it still owns go to their waiters, along with the
+ * priority it inherited from them; the kernel doesn't know about the
+ * uncontended ones, those stay locked.
+ */
+void exitCurrentThread(void){
+	irqflags_t flags = cpu_irq_save();
+	Minithread* t = theCurrentThread;
+	
+	rtRemove(t);
+	
+	while (t->heldMutexes != NULL)
+		unlockMutex(t->heldMutexes);
+	
+	if (t->joiner != NULL){
+		wakeThread(t->joiner);
+		t->joiner = NULL;
+		t->state = THREAD_DEAD;
+	} else if (t->detached){
+		t->state = THREAD_DEAD;
+	} else {
+		t->state = THREAD_ZOMBIE;
+	}
+	
+	cpu_irq_restore(flags);
+	requestContextSwitch();
+}
+
+/*
+ * Waits for thread tid to exit and reclaims it. Returns 0 once it is gone
+ * (right away if it already exited), or -1 if tid can't be joined. The
+ * running thread is blocked until then; the 0 it gets back is stored now.
+ */
+int joinThreadById(int tid){
+	irqflags_t flags = cpu_irq_save();
+	Minithread* t;
+	
+	if (tid < 0 || tid >= numOfThreads){
+		cpu_irq_restore(flags);
+		return -1;
+	}
+	
+	t = &threads[tid];
+	if (!t->alive || t->detached || t->joiner != NULL || t == theCurrentThread){
+		cpu_irq_restore(flags);
+		return -1;
+	}
+	
+	if (t->state == THREAD_ZOMBIE){
+		reapThread(t);
+	} else {
+		t->joiner = theCurrentThread;
+		theCurrentThread->state = THREAD_BLOCKED;
+		theCurrentThread->stateTick = kernelTicks;
+		requestContextSwitch();
+	}
+	
+	cpu_irq_restore(flags);
+	return 0;
+}
+
+/*
+ * Lets thread tid be reclaimed as soon as it exits, without a join.
+ * Returns 0, or -1 if tid can't be detached.
+ */
+int detachThreadById(int tid){
+	irqflags_t flags = cpu_irq_save();
+	Minithread* t;
+	
+	if (tid < 0 || tid >= numOfThreads || !threads[tid].alive || threads[tid].joiner != NULL){
+		cpu_irq_restore(flags);
+		return -1;
+	}
+	
+	t = &threads[tid];
+	t->detached = true;
+	if (t->state == THREAD_ZOMBIE)
+		reapThread(t);
+	
+	cpu_irq_restore(flags);
+	return 0;
+}
+
+/*
+ * Copies the cpu accounting of thread tid into s, including the interval
+ * it is in right now. Returns 0, 1 if the slot is free or -1 past the last
+ * slot, so the threads can be walked by counting tid up from 0.
+ */
+int getThreadStats(int tid, ThreadStats* s){
+	irqflags_t flags = cpu_irq_save();
+	uint32_t now = cpu_cycle_counter_read();
+	Minithread* t;
+	
+	if (tid < 0 || tid >= numOfThreads){
+		cpu_irq_restore(flags);
+		return -1;
+	}
+	
+	t = &threads[tid];
+	if (!t->alive){
+		cpu_irq_restore(flags);
+		return 1;
+	}
+	
+	s->name = t->name;
+	s->state = t->state;
+	s->priority = t->priority;
+	s->switches = t->switches;
+	s->runCycles = t->runCycles;
+	s->readyCycles = t->readyCycles;
+	s->sleepTicks = t->sleepTicks;
+	s->stackWords = t->stackWords - STACK_GUARD_WORDS;
+	s->stackPeak = stackPeak(t);
+	
+	s->periodUs = 0;
+	s->jobs = 0;
+	s->deadlineMisses = 0;
+	s->budgetOverruns = 0;
+	s->maxLatencyCycles = 0;
+	if (t->rt != NULL){
+		s->periodUs = t->rt->periodUs;
+		s->jobs = t->rt->jobs;
+		s->deadlineMisses = t->rt->deadlineMisses;
+		s->budgetOverruns = t->rt->budgetOverruns;
+		s->maxLatencyCycles = t->rt->maxLatency;
+	}
+	
+	if (t == theCurrentThread)
+		s->runCycles += now - t->stamp;
+	else if (t->state == THREAD_READY)
+		s->readyCycles += now - t->stamp;
+	else if (t->state == THREAD_SLEEPING || t->state == THREAD_BLOCKED)
+		s->sleepTicks += kernelTicks - t->stateTick;
+	
+	//ticks are a fixed number of cycles, and keep counting while the
+	//core sleeps when the cycle counter doesn't
+	s->uptimeCycles = (uint64_t) kernelTicks * (SysTick->LOAD + 1);
+	
+	cpu_irq_restore(flags);
+	return 0;
+}
+
+
+/*
+ * Inserts a thread in a wait list behind the threads of the same or higher
+ * priority, so the list is served by priority and then in fifo order.
+ */
+static void waitInsert(Minithread** list, Minithread* t){
+	while (*list != NULL && (*list)->priority <= t->priority)
+		list = &(*list)->waitNext;
+	
+	t->waitNext = *list;
+	*list = t;
+}
+
+static void waitRemove(Minithread** list, Minithread* t){
+	while (*list != NULL && *list != t)
+		list = &(*list)->waitNext;
+	if (*list != NULL)
+		*list = t->waitNext;
+	t->waitNext = NULL;
+}
+
+/*
+ * Blocks the running thread in a wait list for up to timeoutMs. Whatever
+ * wakes it up writes its result into the stacked r0 in frame; until then
+ * it holds the timeout result the SVC returned.
+ */
+static void waitBlock(Minithread** list, uint32_t timeoutMs, uint32_t* frame){
+	Minithread* self = theCurrentThread;
+	
+	self->state = THREAD_BLOCKED;
+	self->stateTick = kernelTicks;
+	self->waitList = list;
+	self->result = frame;
+	waitInsert(list, self);
+	if (timeoutMs != WAIT_FOREVER)
+		sleepInsert(self, MS_TO_KERNEL_TICKS(timeoutMs));
+	
+	requestContextSwitch();
+}
+
+/*
+ * Wakes a thread up from the wait list it is in, with the given result.
+ */
+static void waitWake(Minithread* t, uint32_t result){
+	waitRemove(t->waitList, t);
+	t->waitList = NULL;
+	sleepRemove(t);
+	t->result[0] = result;
+	wakeThread(t);
+	
+	if (theCurrentThread != NULL && t->priority < theCurrentThread->priority)
+		requestContextSwitch();
+}
+
+/*
+ * Thread that owns m, or NULL if it is free.
+ */
+static Minithread* mutexOwner(Mutex* m){
+	uint32_t id = m->lock & ~MUTEX_CONTENDED;
+	
+	return (id != 0) ? &threads[id - 1] : NULL;
+}
+
+/*
+ * Contended mutexes are linked into a list of their owner. A mutex that
+ * the owner took and gives back without contention is never in it.
+ */
+static void heldRemove(Minithread* t, Mutex* m){
+	Mutex** link = &t->heldMutexes;
+	
+	while (*link != NULL && *link != m)
+		link = &(*link)->nextHeld;
+	if (*link != NULL)
+		*link = m->nextHeld;
+	m->nextHeld = NULL;
+}
+
+/*
+ * Priority t should run at: its own, or that of the highest priority
+ * thread waiting on a mutex it owns.
+ */
+static uint8_t inheritedPriority(Minithread* t){
+	uint8_t p = t->basePriority;
+	Mutex* m;
+	
+	for (m = t->heldMutexes; m != NULL; m = m->nextHeld){
+		if (m->waiters != NULL && m->waiters->priority < p)
+			p = m->waiters->priority;
+	}
+	return p;
+}
+
+/*
+ * Changes the priority of t, moving it in the ready queue or in the wait
+ * list it is in. If t waits on a mutex, the change is passed on to the
+ * owner, and on along the chain of owners that are waiting themselves.
+ */
+static void setPriority(Minithread* t, uint8_t p){
+	while (t != NULL && t->priority != p){
+		if (t != theCurrentThread && t->state == THREAD_READY){
+			readyRemove(t);
+			t->priority = p;
+			readyEnqueue(t);
+		} else {
+			t->priority = p;
+		}
+		
+		if (t->waitList == NULL)
+			return;
+		waitRemove(t->waitList, t);
+		waitInsert(t->waitList, t);
+		
+		if (t->waitMutex == NULL)
 			return;
+		t = mutexOwner(t->waitMutex);
+		if (t != NULL)
+			p = inheritedPriority(t);
+	}
+}
+
+/*
+ * Takes a thread off the object it waits on when its timeout expires.
+ * The owner of a mutex may lose the priority it inherited from it.
+ */
+static void waitAbort(Minithread* t){
+	Mutex* m = t->waitMutex;
+	
+	waitRemove(t->waitList, t);
+	t->waitList = NULL;
+	t->waitMutex = NULL;
+	
+	if (m != NULL){
+		Minithread* owner = mutexOwner(m);
+		
+		if (m->waiters == NULL){
+			heldRemove(owner, m);
+			m->lock &= ~MUTEX_CONTENDED;
 		}
+		setPriority(owner, inheritedPriority(owner));
+	}
+}
 
-		 //save psp
-		 theCurrentThread.sp = __get_PSP();
- 
-		 //change current thread
-		 scheduler();
+/*
+ * Kernel side of mutexLock, once taking m without the kernel failed. Takes
+ * m if it was freed since, otherwise blocks the running thread on it for up
+ * to timeoutMs and lends it the running thread's priority. Returns 0 when
+ * m is taken and -1 otherwise; a blocked thread gets 0 written into the
+ * stacked r0 in frame if the mutex is handed to it.
+ */
+int lockMutex(Mutex* m, uint32_t timeoutMs, uint32_t* frame){
+	irqflags_t flags = cpu_irq_save();
+	Minithread* self = theCurrentThread;
+	Minithread* owner = mutexOwner(m);
+	
+	if (owner == NULL){
+		m->lock = (self - threads) + 1;
+		cpu_irq_restore(flags);
+		return 0;
+	}
+	
+	if (owner == self || timeoutMs == 0){
+		cpu_irq_restore(flags);
+		return -1;
+	}
+	
+	//from now on the owner can only give it back through the kernel
+	if (!(m->lock & MUTEX_CONTENDED)){
+		m->lock |= MUTEX_CONTENDED;
+		m->nextHeld = owner->heldMutexes;
+		owner->heldMutexes = m;
+	}
+	
+	self->waitMutex = m;
+	waitBlock(&m->waiters, timeoutMs, frame);
+	
+	if (self->priority < owner->priority)
+		setPriority(owner, self->priority);
+	
+	cpu_irq_restore(flags);
+	return -1;
+}
 
-		//restore psp
-		__set_PSP( theCurrentThread.sp );
- 		
- 		//restore software context
-		 if( theCurrentThread.execFirstTime ){	 
-			//newly created threads have no soft context so we put one
-			theCurrentThread.execFirstTime = false;
-			save_context();	
-		 }
-		 
-		 load_context();
-		  
+/*
+ * Kernel side of mutexUnlock for a contended mutex. Hands m straight to the
+ * highest priority waiter and drops the priority the running thread
+ * inherited through it. Returns 0, or -1 if the running thread isn't the
+ * owner.
+ */
+int unlockMutex(Mutex* m){
+	irqflags_t flags = cpu_irq_save();
+	Minithread* self = theCurrentThread;
+	Minithread* next = m->waiters;
+	
+	if (mutexOwner(m) != self){
+		cpu_irq_restore(flags);
+		return -1;
+	}
+	
+	if (m->lock & MUTEX_CONTENDED)
+		heldRemove(self, m);
+	
+	if (next == NULL){
+		m->lock = 0;
+	} else {
+		next->waitMutex = NULL;
+		waitWake(next, 0);
+		
+		m->lock = (next - threads) + 1;
+		if (m->waiters != NULL){
+			m->lock |= MUTEX_CONTENDED;
+			m->nextHeld = next->heldMutexes;
+			next->heldMutexes = m;
+		}
+		setPriority(next, inheritedPriority(next));
+	}
+	
+	setPriority(self, inheritedPriority(self));
+	if (next != NULL && next->priority < self->priority)
+		requestContextSwitch();
+	
+	cpu_irq_restore(flags);
+	return 0;
 }
 
+/*
+ * Kernel side of semWait, once the count was found at 0. Takes one from the
+ * count if it went up since, otherwise blocks the running thread for up to
+ * timeoutMs. Returns 0 when the count is taken and -1 otherwise; a blocked
+ * thread gets 0 written into frame by postSemaphore.
+ */
+int waitSemaphore(Semaphore* s, uint32_t timeoutMs, uint32_t* frame){
+	irqflags_t flags = cpu_irq_save();
+	
+	if (s->count > 0){
+		s->count--;
+		cpu_irq_restore(flags);
+		return 0;
+	}
+	
+	if (timeoutMs != 0)
+		waitBlock(&s->waiters, timeoutMs, frame);
+	
+	cpu_irq_restore(flags);
+	return -1;
+}
 
+/*
+ * Hands the count to the highest priority waiter, or adds one to it if
+ * nobody waits. Also called straight from interrupt handlers.
+ */
+void postSemaphore(Semaphore* s){
+	irqflags_t flags = cpu_irq_save();
+	
+	if (s->waiters != NULL)
+		waitWake(s->waiters, 0);
+	else
+		s->count++;
+	
+	cpu_irq_restore(flags);
+}
 
-void PendSV_Handler(void){
-	//Doing context switching here allows for applications
-	//to "yield", meaning they can voluntarily generate a context switch
-	//proper yielding requires setting a yielding time though.
+/*
+ * Flags of mask that are enough to end a wait in the given mode, or 0.
+ */
+static uint32_t eventMatch(uint32_t flags, uint32_t mask, uint8_t mode){
+	if (mode & EVENT_WAIT_ALL)
+		return ((flags & mask) == mask) ? mask : 0;
+	return flags & mask;
+}
+
+/*
+ * Kernel side of eventWait. Returns the flags of mask that end the wait,
+ * clearing them with EVENT_CLEAR, or blocks the running thread until they
+ * are set for up to timeoutMs and returns 0. A blocked thread gets the
+ * flags written into frame by setEvents.
+ */
+uint32_t waitEvents(EventFlags* e, uint32_t mask, uint8_t mode, uint32_t timeoutMs, uint32_t* frame){
+	irqflags_t flags = cpu_irq_save();
+	uint32_t match = eventMatch(e->flags, mask, mode);
+	
+	if (match != 0){
+		if (mode & EVENT_CLEAR)
+			e->flags &= ~match;
+		cpu_irq_restore(flags);
+		return match;
+	}
+	
+	if (timeoutMs != 0 && mask != 0){
+		theCurrentThread->waitFlags = mask;
+		theCurrentThread->waitMode = mode;
+		waitBlock(&e->waiters, timeoutMs, frame);
+	}
 	
-	//code from systick??
-	  
+	cpu_irq_restore(flags);
+	return 0;
 }
 
+/*
+ * Sets flags in e and wakes up every waiter whose wait they end, highest
+ * priority first, so a waiter that clears flags takes them from the ones
+ * after it. Also called straight from interrupt handlers.
+ */
+void setEvents(EventFlags* e, uint32_t bits){
+	irqflags_t flags = cpu_irq_save();
+	Minithread* t = e->waiters;
+	
+	e->flags |= bits;
+	while (t != NULL){
+		Minithread* next = t->waitNext;
+		uint32_t match = eventMatch(e->flags, t->waitFlags, t->waitMode);
+		
+		if (match != 0){
+			if (t->waitMode & EVENT_CLEAR)
+				e->flags &= ~match;
+			waitWake(t, match);
+		}
+		t = next;
+	}
+	
+	cpu_irq_restore(flags);
+}
 
+/*
+ * True if periodic task a gets a higher priority than b.
+ */
+static bool rtBefore(RtTask* a, RtTask* b){
+	#ifdef RT_EDF
+	//one waiting for its release has no deadline to go by
+	if (a->waiting != b->waiting)
+		return !a->waiting;
+	return (int32_t) (a->deadline - b->deadline) < 0;
+	#else
+	return a->periodUs < b->periodUs;
+	#endif
+}
 
-void del_process(void){
-	//Making use of this "thread-removing function" requires suing a flag 
-	//for setting threads as active/unactive...so add a new field in the MiniThread data
-	//structure. Basically, create initially as many threads as the system will require, then
-	//when a new thread is created look for an unactive thread and set as active. Removing hen requires
-	//setting (withi this function) the thread as unactive and then call context switch....
-	//The scheduler obviously must look distinguish between active/unactive threads
+/*
+ * Hands out the priorities of the periodic threads again. A throttled one
+ * stays below every other thread but idle until its next release.
+ */
+static void rtAssignPriorities(void){
+	RtTask* order[RT_MAX_TASKS];
+	int n = 0;
+	int i, j;
 	
-	//1) Set thread as unused
-	//2) Do context switch by pending an SVC: SCB->ICSR |= (1<<28);
+	//insertion sort, there are only a handful
+	for (i = 0; i < RT_MAX_TASKS; i++){
+		RtTask* rt = &rtTasks[i];
+		
+		if (rt->thread == NULL)
+			continue;
+		for (j = n; j > 0 && rtBefore(rt, order[j - 1]); j--)
+			order[j] = order[j - 1];
+		order[j] = rt;
+		n++;
+	}
 	
-	while(1); //once the context changes, the program will no longer return to this thread
+	for (i = 0; i < n; i++){
+		Minithread* t = order[i]->thread;
+		
+		t->basePriority = order[i]->throttled ? PRIORITY_RT_THROTTLED : PRIORITY_RT_HIGHEST + i;
+		setPriority(t, inheritedPriority(t));
+	}
+}
+
+/*
+ * Tick the job released at rt->release is due by.
+ */
+static uint32_t rtDeadline(RtTask* rt){
+	return rt->release + (rt->phase + rt->deadlineUs + TICK_US - 1) / TICK_US;
+}
 
+/*
+ * Moves rt on to its next release.
+ */
+static void rtAdvance(RtTask* rt){
+	rt->phase += rt->periodUs;
+	rt->release += rt->phase / TICK_US;
+	rt->phase %= TICK_US;
 }
 
+/*
+ * Starts a new job of periodic thread t.
+ */
+static void rtRelease(Minithread* t){
+	RtTask* rt = t->rt;
+	
+	rt->waiting = false;
+	rt->throttled = false;
+	rt->started = false;
+	rt->jobStart = t->runCycles;
+	rt->deadline = rtDeadline(rt);
+	rt->jobs++;
+	rtAssignPriorities();
+}
 
+/*
+ * Throttles the running periodic thread once its job has used up its
+ * budget. Checked every tick.
+ */
+static void rtBudgetTick(Minithread* t){
+	RtTask* rt = t->rt;
+	
+	if (rt == NULL || rt->budgetCycles == 0 || rt->throttled)
+		return;
+	
+	if (t->runCycles + cpu_cycles_since(t->stamp) - rt->jobStart > rt->budgetCycles){
+		rt->throttled = true;
+		rt->budgetOverruns++;
+		rtAssignPriorities();
+		requestContextSwitch();
+	}
+}
+
+/*
+ * Makes t a plain thread again, with the priority it had before.
+ */
+static void rtRemove(Minithread* t){
+	RtTask* rt = t->rt;
+	
+	if (rt == NULL)
+		return;
+	
+	rt->thread = NULL;
+	t->rt = NULL;
+	t->basePriority = rt->plainPriority;
+	setPriority(t, inheritedPriority(t));
+	rtAssignPriorities();
+}
+
+/*
+ * Makes the running thread periodic, or changes its parameters, with its
+ * first job released now. A period of 0 makes it a plain thread again.
+ * Returns 0, or -1 if every periodic slot is taken.
+ */
+int startPeriodic(uint32_t periodUs, uint32_t deadlineUs, uint32_t budgetUs){
+	irqflags_t flags = cpu_irq_save();
+	Minithread* t = theCurrentThread;
+	RtTask* rt = t->rt;
+	int i;
+	
+	if (periodUs == 0){
+		rtRemove(t);
+		cpu_irq_restore(flags);
+		requestContextSwitch();
+		return 0;
+	}
+	
+	for (i = 0; rt == NULL && i < RT_MAX_TASKS; i++){
+		if (rtTasks[i].thread == NULL){
+			rt = &rtTasks[i];
+			rt->thread = t;
+			rt->plainPriority = t->basePriority;
+			rt->jobs = 0;
+			rt->deadlineMisses = 0;
+			rt->budgetOverruns = 0;
+			rt->maxLatency = 0;
+			t->rt = rt;
+		}
+	}
+	if (rt == NULL){
+		cpu_irq_restore(flags);
+		return -1;
+	}
+	
+	rt->periodUs = periodUs;
+	rt->deadlineUs = (deadlineUs != 0) ? deadlineUs : periodUs;
+	rt->budgetCycles = budgetUs * (sysclk_get_cpu_hz() / 1000000);
+	rt->release = kernelTicks;
+	rt->phase = 0;
+	rtRelease(t);
+	rt->started = true;
+	
+	cpu_irq_restore(flags);
+	requestContextSwitch();
+	return 0;
+}
 
+/*
+ * Ends the job of the running periodic thread and puts it to sleep until
+ * its next release. Releases whose deadline already went by are skipped.
+ * Returns the deadlines missed, counting the job that just ended if it was
+ * late, or -1 if the thread isn't periodic.
+ */
+int waitNextPeriod(void){
+	irqflags_t flags = cpu_irq_save();
+	Minithread* t = theCurrentThread;
+	RtTask* rt = t->rt;
+	int missed = 0;
+	
+	if (rt == NULL){
+		cpu_irq_restore(flags);
+		return -1;
+	}
+	
+	if ((int32_t) (kernelTicks - rt->deadline) > 0)
+		missed++;
+	
+	rtAdvance(rt);
+	while ((int32_t) (kernelTicks - rtDeadline(rt)) > 0){
+		missed++;
+		rtAdvance(rt);
+	}
+	rt->deadlineMisses += missed;
+	
+	if ((int32_t) (rt->release - kernelTicks) <= 0){
+		//due already, the next job goes on right away
+		rtRelease(t);
+		rt->started = true;
+	} else {
+		rt->waiting = true;
+		t->state = THREAD_SLEEPING;
+		t->stateTick = kernelTicks;
+		sleepInsert(t, rt->release - kernelTicks);
+	}
+	
+	cpu_irq_restore(flags);
+	requestContextSwitch();
+	return missed;
+}
 
+/*
+ * Creates a thread, callable from privileged code only (boot code, interrupt
+ * handlers and kernel threads). Returns its id, or -1 if there is no
+ * control block or stack left. The stack size is in words.
+ */
 int createThread ( void (*startAddress)(void), char *name,  int stackSize ){
+		return newThread(startAddress, name, stackSize, PRIORITY_NORMAL, 1, false);
+}
+
+/*
+ * Same as createThread, with a priority and a time slice of quantumMs,
+ * rounded up to whole ticks and capped at QUANTUM_MAX_MS.
+ */
+int createThreadEx ( void (*startAddress)(void), char *name,  int stackSize, uint8_t priority, uint32_t quantumMs ){
+		if( priority > PRIORITY_LOWEST )
+			priority = PRIORITY_LOWEST;
+		if( quantumMs > QUANTUM_MAX_MS )
+			quantumMs = QUANTUM_MAX_MS;
+		
+		return newThread(startAddress, name, stackSize, priority, QUANTUM_TICKS(quantumMs), false);
+}
+
+/*
+ * Creates a privileged thread for a kernel service. Returns its id, or -1.
+ */
+int createKernelThread ( void (*startAddress)(void), char *name,  int stackSize, uint8_t priority ){
+		return newThread(startAddress, name, stackSize, priority, 1, true);
+}
+
+static int newThread ( void (*startAddress)(void), char *name,  int stackSize, uint8_t priority, uint8_t quantum, bool privileged ){
+		irqflags_t flags = cpu_irq_save();
+		Minithread* t;
+		uint32_t* stack;
+		uint8_t cls;
 		
 		//cant create more threads
-		if( numOfThreads >= MAX_NUM_OF_THREADS )
+		if( freeThreads == NULL && numOfThreads >= MAX_THREADS ){
+			cpu_irq_restore(flags);
 			return -1;
-			
-		threads[numOfThreads].name = name;	
-		threads[numOfThreads].execFirstTime = true;
-		threads[numOfThreads].bp = (&_estack2 - 0x20) - (allocatedStack + stackSize);
-		threads[numOfThreads].sp = threads[numOfThreads].bp - 0x20;  //make space for manually-inserted hardware context
-		
-		allocatedStack += stackSize; 
-		
-		//initially the task does not have a hardware context
-		//so we insert one ourselves
-		uint32_t* sp = threads[numOfThreads].sp;
-		
-		((uint32_t*)sp)[0] = ((uint32_t) 0); //r0
-		((uint32_t*)sp)[1] = ((uint32_t) 0); //r1
-		((uint32_t*)sp)[2] = ((uint32_t) 0); //r2
-		((uint32_t*)sp)[3] = ((uint32_t) 0); //r3
-		((uint32_t*)sp)[4] = ((uint32_t) 0); //r12
-		((uint32_t*)sp)[5] = ((uint32_t) del_process); //lr
-		((uint32_t*)sp)[6] = ((uint32_t) startAddress); //pc
-		((uint32_t*)sp)[7] = ((uint32_t) 0x21000000); //psr
+		}
+		
+		stack = stackAlloc(stackSize, &cls);
+		if( stack == NULL ){
+			cpu_irq_restore(flags);
+			return -1;
+		}
+		
+		//reuse the control block of a reclaimed thread first
+		if( freeThreads != NULL ){
+			t = freeThreads;
+			freeThreads = t->next;
+		} else {
+			t = &threads[numOfThreads++];
+		}
+		
+		t->name = name;
+		t->alive = true;
+		t->priority = priority;
+		t->basePriority = priority;
+		t->quantum = quantum;
+		t->sliceLeft = 0;
+		t->rt = NULL;
+		t->waitList = NULL;
+		t->waitMutex = NULL;
+		t->heldMutexes = NULL;
+		t->state = THREAD_READY;
+		t->privileged = privileged;
+		t->detached = false;
+		t->joiner = NULL;
+		t->bp = stack;
+		t->stackClass = cls;
+		t->stackWords = stackClassSize[cls];
+		t->stamp = cpu_cycle_counter_read();
+		t->switches = 0;
+		t->sleepTicks = 0;
+		t->runCycles = 0;
+		t->readyCycles = 0;
+		t->sp = portInitStack(t - threads, stack + stackClassSize[cls], startAddress);
+		stackPaint(stack, t->sp);
 
 		//enqueues the just created thread.
-		queue[tail] = threads[numOfThreads];
-		tail = (tail + 1) % QUEUE_SIZE;
+		readyEnqueue(t);
+		preemptFor(t);
 		
-		numOfThreads++;
-}
\ No newline at end of file
+		cpu_irq_restore(flags);
+		return t - threads;
+}
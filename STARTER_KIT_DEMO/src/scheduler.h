@@ -0,0 +1,40 @@
+/*
+ * Scheduler
+ *
+ * Kernel side interface of the scheduler, used by the syscalls
+ * and by interrupt handlers. Only callable from privileged code.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+#include "threads.h"
+#include "sync.h"
+
+void scheduler(void);
+void startScheduler(void);
+int createKernelThread(void (*)(void), char*, int, uint8_t);
+uint32_t kernelMillis(void);
+void requestContextSwitch(void);
+uint32_t* switchContext(uint32_t*);
+void sleepCurrentThread(uint32_t);
+void yieldCurrentThread(void);
+int startPeriodic(uint32_t, uint32_t, uint32_t);
+int waitNextPeriod(void);
+void exitCurrentThread(void);
+int joinThreadById(int);
+int detachThreadById(int);
+int getThreadStats(int, ThreadStats*);
+int addIdleHook(IdleHook);
+int lockMutex(Mutex*, uint32_t, uint32_t*);
+int unlockMutex(Mutex*);
+int waitSemaphore(Semaphore*, uint32_t, uint32_t*);
+void postSemaphore(Semaphore*);
+uint32_t waitEvents(EventFlags*, uint32_t, uint8_t, uint32_t, uint32_t*);
+void setEvents(EventFlags*, uint32_t);
+
+#endif /* SCHEDULER_H_ */
\ No newline at end of file
@@ -0,0 +1,132 @@
+/*
+ * Synchronization
+ *
+ * User-level side of the mutexes, semaphores and event flags. Their words
+ * are changed with LDREX/STREX, and the kernel is asked via SVCs only when
+ * a thread has to block or be woken up. Exceptions clear the exclusive
+ * monitor, so a STREX fails if the kernel ran in between.
+ *
+ * Interrupt handlers can't issue SVCs (an SVC at their priority would
+ * escalate to a hard fault), but they are privileged, so semPost and
+ * eventSet call the kernel directly there.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include "sysnums.h"
+#include "threads.h"
+#include "sync.h"
+#include "scheduler.h"
+
+//true while in an interrupt or exception handler
+#define IN_HANDLER() (__get_IPSR() != 0)
+
+/*
+ * Takes m, waiting up to timeoutMs for it. Returns 0, or -1 if
+ * it timed out or the caller already owns m.
+ */
+int mutexLock(Mutex* m, uint32_t timeoutMs) {
+    uint32_t self = threadSelf() + 1;
+
+    if (__LDREXW(&m->lock) == 0 && __STREXW(self, &m->lock) == 0) {
+        //nothing the mutex protects may be read before it is taken
+        __DMB();
+        return 0;
+    }
+    __CLREX();
+
+    return (int) svc_r0_r1(SYSCALL_MUTEX_LOCK, m, timeoutMs);
+}
+
+/*
+ * Gives m back, to the highest priority waiter if there is one.
+ * Returns 0, or -1 if the caller doesn't own m.
+ */
+int mutexUnlock(Mutex* m) {
+    uint32_t self = threadSelf() + 1;
+
+    __DMB();
+    if (__LDREXW(&m->lock) == self && __STREXW(0, &m->lock) == 0)
+        return 0;
+    __CLREX();
+
+    return (int) svc_r0(SYSCALL_MUTEX_UNLOCK, m);
+}
+
+/*
+ * Takes one from the count of s, waiting up to timeoutMs while it is 0.
+ * Returns 0, or -1 if it timed out.
+ */
+int semWait(Semaphore* s, uint32_t timeoutMs) {
+    uint32_t count = __LDREXW(&s->count);
+
+    if (count > 0 && __STREXW(count - 1, &s->count) == 0) {
+        __DMB();
+        return 0;
+    }
+    __CLREX();
+
+    return (int) svc_r0_r1(SYSCALL_SEM_WAIT, s, timeoutMs);
+}
+
+/*
+ * Adds one to the count of s, or hands it to the first waiter.
+ */
+void semPost(Semaphore* s) {
+    uint32_t count;
+
+    if (IN_HANDLER()) {
+        postSemaphore(s);
+        return;
+    }
+
+    //waiters only change inside the kernel, which would make the STREX fail
+    __DMB();
+    count = __LDREXW(&s->count);
+    if (s->waiters == NULL && __STREXW(count + 1, &s->count) == 0)
+        return;
+    __CLREX();
+
+    svc_r0(SYSCALL_SEM_POST, s);
+}
+
+/*
+ * Sets the count of s. Nobody waits on s, so the kernel isn't involved.
+ */
+void semInit(Semaphore* s, uint32_t count) {
+    do {
+        (void) __LDREXW(&s->count);
+    } while (__STREXW(count, &s->count) != 0);
+}
+
+/*
+ * Waits up to timeoutMs for any (or with EVENT_WAIT_ALL, all) of the flags
+ * in mask. Returns them, or 0 if it timed out.
+ */
+uint32_t eventWait(EventFlags* e, uint32_t mask, uint8_t mode, uint32_t timeoutMs) {
+    return svc_r0_r3(SYSCALL_EVENT_WAIT, e, mask, mode, timeoutMs);
+}
+
+/*
+ * Sets flags in e, waking up the threads waiting on them.
+ */
+void eventSet(EventFlags* e, uint32_t flags) {
+    if (IN_HANDLER())
+        setEvents(e, flags);
+    else
+        svc_r0_r1(SYSCALL_EVENT_SET, e, flags);
+}
+
+/*
+ * Clears flags in e. Nobody wakes up from flags being cleared,
+ * so the kernel isn't involved.
+ */
+void eventClear(EventFlags* e, uint32_t flags) {
+    uint32_t value;
+
+    do {
+        value = __LDREXW(&e->flags);
+    } while (__STREXW(value & ~flags, &e->flags) != 0);
+}
@@ -0,0 +1,73 @@
+/*
+ * Synchronization
+ *
+ * Mutexes, counting semaphores and event flags shared between threads.
+ * When nobody has to wait or be woken up they are handled without entering
+ * the kernel; otherwise the calls below make a system call. Semaphores and
+ * event flags can also be signalled from interrupt handlers.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef SYNC_H_
+#define SYNC_H_
+
+#include <stdint.h>
+
+//Timeout that never expires
+#define WAIT_FOREVER		0xFFFFFFFFUL
+
+//Set in Mutex.lock while threads wait for the mutex
+#define MUTEX_CONTENDED		0x80000000UL
+
+struct Minithread;
+
+typedef struct Mutex{
+	volatile uint32_t lock;			//id of the owner + 1, 0 when free
+	struct Minithread* waiters;		//highest priority first, kernel only
+	struct Mutex* nextHeld;			//next contended mutex of the owner, kernel only
+}Mutex;
+
+#define MUTEX_INIT { 0, 0, 0 }
+
+typedef struct Semaphore{
+	volatile uint32_t count;
+	struct Minithread* waiters;		//highest priority first, kernel only
+}Semaphore;
+
+#define SEMAPHORE_INIT(count) { (count), 0 }
+
+//eventWait modes. By default any flag of the mask ends the wait
+#define EVENT_WAIT_ANY		0x00
+#define EVENT_WAIT_ALL		0x01	//wait until all flags of the mask are set
+#define EVENT_CLEAR			0x02	//clear the flags that ended the wait
+
+typedef struct EventFlags{
+	volatile uint32_t flags;
+	struct Minithread* waiters;		//highest priority first, kernel only
+}EventFlags;
+
+#define EVENT_FLAGS_INIT { 0, 0 }
+
+// Returns 0 once the mutex is taken, or -1 if it wasn't within timeoutMs
+// (right away for 0). While a higher priority thread waits, the owner runs
+// at that thread's priority. Mutexes are not recursive
+int mutexLock( Mutex* m, uint32_t timeoutMs );
+int mutexUnlock( Mutex* m );
+
+// Returns 0 once the count could be taken, or -1 if it stayed 0 for
+// timeoutMs. Not from interrupt handlers
+int semWait( Semaphore* s, uint32_t timeoutMs );
+void semPost( Semaphore* s );
+
+// Sets the count of s, for reusing one. No thread may be waiting on s
+void semInit( Semaphore* s, uint32_t count );
+
+// Returns the flags of mask that ended the wait, or 0 if none did within
+// timeoutMs. Not from interrupt handlers
+uint32_t eventWait( EventFlags* e, uint32_t mask, uint8_t mode, uint32_t timeoutMs );
+void eventSet( EventFlags* e, uint32_t flags );
+void eventClear( EventFlags* e, uint32_t flags );
+
+#endif /* SYNC_H_ */
@@ -12,6 +12,13 @@
 #include <asf.h>
 #include "sysnums.h"
 #include "data.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "trace.h"
+#include "port.h"
+#include "batch.h"
+#include "device.h"
+#include <inttypes.h>
 
 void MOSTimerSet(int, void (*) (void));
 void MOSTimerStop(void);
@@ -28,6 +35,8 @@ char MOSGetc(void);
 bool MOSReceivedChar(void);
 void MOSRead(char*, int);
 void MOSWrite(const char*, int);
+bool MOSTryWrite(const char*, int);
+void MOSDumpThreadStats(void);
 void SVC_Switch(unsigned int *);
 void SVC_Error(int);
 
@@ -35,97 +44,393 @@ void SVC_Error(int);
 //							SVC Handler									//
 //////////////////////////////////////////////////////////////////////////
 
-/*  
- * Copies either the PSP or the MSP address into the stack, then calls
- * SVC_Switch.
- */
-void SVC_Handler(void) {
-    asm (
-                "tst lr, #4\t\n" /* Check EXC_RETURN[2] */
-                "ite eq\t\n"
-                "mrseq r0, msp\t\n"
-                "mrsne r0, psp\t\n"
-                "b %[SVC_Switch]\t\n"
-                : /* no output */
-                : [SVC_Switch] "i" (SVC_Switch) /* input */
-                : "r0" /* clobber */
-                );
+//One syscall. Gets the stacked frame, r0-r3 in svc_args[0..3], and returns
+//what goes back to the caller in r0. The ones that block keep the frame
+//to store their result in when they wake up
+typedef uint32_t (*SyscallHandler)(unsigned int* svc_args);
+
+//Syscalls refused for a bad number or argument, they return SYSCALL_ERROR
+uint32_t syscallErrors = 0;
+
+//Checks on the arguments that point to memory: an object of the kernel
+//the caller writes through, a string it only reads, and a function the
+//kernel calls privileged, which has to be in flash
+#define ARG_ARRAY(arg, type, count) \
+	(portWritable((arg), (count) * sizeof(type)) && ((arg) & (__alignof__(type) - 1)) == 0)
+#define ARG_OBJECT(arg, type)	ARG_ARRAY(arg, type, 1)
+#define ARG_READABLE(arg)	portReadable((arg), 1)
+#define ARG_FUNCTION(arg)	portExecutable((arg) & ~1UL, 2)
+
+static uint32_t badArgument(void) {
+    syscallErrors++;
+    return SYSCALL_ERROR;
 }
 
-/*  
- * Uses the passed argument (which is actually the R0 register value)
- * to switch on and call the corresponding case.
- */
-void SVC_Switch(unsigned int * svc_args) {
+static uint32_t sysLed0Off(unsigned int* svc_args) {
+    MOSLEDSet(LED0, LED_OFF);
+    return 0;
+}
 
-    /* The value that this switch statement switches on is svc_args, but using only 
-     * the value stored in the R0 register.
-     */
-    switch (((char *) svc_args[6])[-2]) {
-            //for LED0 on/off
-        case SYSCALL_LED0_OFF: MOSLEDSet(LED0, LED_OFF);
-            break;
-        case SYSCALL_LED0_ON: MOSLEDSet(LED0, LED_ON);
-            break;
+static uint32_t sysLed0On(unsigned int* svc_args) {
+    MOSLEDSet(LED0, LED_ON);
+    return 0;
+}
 
-            //for LED1 on/off
-        case SYSCALL_LED1_OFF: ioport_set_pin_level(IO1_LED1_PIN, LED_OFF);
-            break;
-        case SYSCALL_LED1_ON: ioport_set_pin_level(IO1_LED1_PIN, LED_ON);
-            break;
+static uint32_t sysLed1Off(unsigned int* svc_args) {
+    ioport_set_pin_level(IO1_LED1_PIN, LED_OFF);
+    return 0;
+}
+
+static uint32_t sysLed1On(unsigned int* svc_args) {
+    ioport_set_pin_level(IO1_LED1_PIN, LED_ON);
+    return 0;
+}
+
+static uint32_t sysLed2Off(unsigned int* svc_args) {
+    ioport_set_pin_level(IO1_LED2_PIN, LED_OFF);
+    return 0;
+}
+
+static uint32_t sysLed2On(unsigned int* svc_args) {
+    ioport_set_pin_level(IO1_LED2_PIN, LED_ON);
+    return 0;
+}
+
+static uint32_t sysLed3Off(unsigned int* svc_args) {
+    ioport_set_pin_level(IO1_LED3_PIN, LED_OFF);
+    return 0;
+}
+
+static uint32_t sysLed3On(unsigned int* svc_args) {
+    ioport_set_pin_level(IO1_LED3_PIN, LED_ON);
+    return 0;
+}
+
+//Text at a line (0-3) and a pixel column (0-127) of the OLED
+static uint32_t writeText(unsigned int text, unsigned int page, unsigned int column) {
+    if (!ARG_READABLE(text))
+        return badArgument();
+
+    ssd1306_set_page_address(page);
+    ssd1306_set_column_address(column);
+    ssd1306_write_text((char*) (uintptr_t) text);
+    return 0;
+}
+
+static uint32_t sysWriteCharToScreen(unsigned int* svc_args) {
+    return writeText(svc_args[0], 0, 0);
+}
+
+static uint32_t sysWriteStringToScreen(unsigned int* svc_args) {
+    return writeText(svc_args[0], svc_args[1], 0);
+}
+
+static uint32_t sysWriteStringToScreenPosition(unsigned int* svc_args) {
+    return writeText(svc_args[0], svc_args[1], svc_args[2]);
+}
+
+//Returns the status of the sensor driver, 0 once the temperature is read
+static uint32_t sysGetTemp(unsigned int* svc_args) {
+    if (!ARG_OBJECT(svc_args[0], double))
+        return badArgument();
+    return at30tse_read_temperature((double*) (uintptr_t) svc_args[0]);
+}
+
+//The result comes through light_samples
+static uint32_t sysGetLight(unsigned int* svc_args) {
+    adc_start(ADC);
+    return 0;
+}
+
+static uint32_t sysDelay(unsigned int* svc_args) {
+    sleepCurrentThread(svc_args[0]);
+    return 0;
+}
+
+static uint32_t sysClearScreen(unsigned int* svc_args) {
+    ssd1306_clear();
+    return 0;
+}
+
+static uint32_t sysYield(unsigned int* svc_args) {
+    yieldCurrentThread();
+    return 0;
+}
+
+static uint32_t sysExit(unsigned int* svc_args) {
+    exitCurrentThread();
+    return 0;
+}
+
+static uint32_t sysJoin(unsigned int* svc_args) {
+    return joinThreadById((int) svc_args[0]);
+}
+
+static uint32_t sysDetach(unsigned int* svc_args) {
+    return detachThreadById((int) svc_args[0]);
+}
+
+static uint32_t sysThreadStats(unsigned int* svc_args) {
+    if (!ARG_OBJECT(svc_args[1], ThreadStats))
+        return badArgument();
+    return getThreadStats((int) svc_args[0], (ThreadStats*) (uintptr_t) svc_args[1]);
+}
+
+static uint32_t sysDumpThreadStats(unsigned int* svc_args) {
+    MOSDumpThreadStats();
+    return 0;
+}
+
+static uint32_t sysMutexLock(unsigned int* svc_args) {
+    if (!ARG_OBJECT(svc_args[0], Mutex))
+        return badArgument();
+    return lockMutex((Mutex*) (uintptr_t) svc_args[0], svc_args[1], svc_args);
+}
+
+static uint32_t sysMutexUnlock(unsigned int* svc_args) {
+    if (!ARG_OBJECT(svc_args[0], Mutex))
+        return badArgument();
+    return unlockMutex((Mutex*) (uintptr_t) svc_args[0]);
+}
+
+static uint32_t sysSemWait(unsigned int* svc_args) {
+    if (!ARG_OBJECT(svc_args[0], Semaphore))
+        return badArgument();
+    return waitSemaphore((Semaphore*) (uintptr_t) svc_args[0], svc_args[1], svc_args);
+}
 
-            //for LED2 on/off
-        case SYSCALL_LED2_OFF: ioport_set_pin_level(IO1_LED2_PIN, LED_OFF);
+static uint32_t sysSemPost(unsigned int* svc_args) {
+    if (!ARG_OBJECT(svc_args[0], Semaphore))
+        return badArgument();
+    postSemaphore((Semaphore*) (uintptr_t) svc_args[0]);
+    return 0;
+}
+
+static uint32_t sysEventWait(unsigned int* svc_args) {
+    if (!ARG_OBJECT(svc_args[0], EventFlags))
+        return badArgument();
+    return waitEvents((EventFlags*) (uintptr_t) svc_args[0], svc_args[1], (uint8_t) svc_args[2], svc_args[3], svc_args);
+}
+
+static uint32_t sysEventSet(unsigned int* svc_args) {
+    if (!ARG_OBJECT(svc_args[0], EventFlags))
+        return badArgument();
+    setEvents((EventFlags*) (uintptr_t) svc_args[0], svc_args[1]);
+    return 0;
+}
+
+//The timer daemon runs the callback privileged
+static uint32_t sysTimerStart(unsigned int* svc_args) {
+    if (!ARG_OBJECT(svc_args[0], SoftTimer)
+            || !ARG_FUNCTION((uint32_t) (uintptr_t) ((SoftTimer*) (uintptr_t) svc_args[0])->callback))
+        return badArgument();
+    startTimer((SoftTimer*) (uintptr_t) svc_args[0], svc_args[1], svc_args[2]);
+    return 0;
+}
+
+static uint32_t sysTimerStop(unsigned int* svc_args) {
+    if (!ARG_OBJECT(svc_args[0], SoftTimer))
+        return badArgument();
+    stopTimer((SoftTimer*) (uintptr_t) svc_args[0]);
+    return 0;
+}
+
+static uint32_t sysPeriodicStart(unsigned int* svc_args) {
+    return startPeriodic(svc_args[0], svc_args[1], svc_args[2]);
+}
+
+static uint32_t sysPeriodicWait(unsigned int* svc_args) {
+    return waitNextPeriod();
+}
+
+static uint32_t sysIdleHook(unsigned int* svc_args) {
+    if (!ARG_FUNCTION(svc_args[0]))
+        return badArgument();
+    return addIdleHook((IdleHook) (uintptr_t) svc_args[0]);
+}
+
+static bool setLed(uint8_t led, bool on) {
+    bool level = on ? LED_ON : LED_OFF;
+
+    switch (led) {
+        case 0: MOSLEDSet(LED0, level);
             break;
-        case SYSCALL_LED2_ON: ioport_set_pin_level(IO1_LED2_PIN, LED_ON);
+        case 1: ioport_set_pin_level(IO1_LED1_PIN, level);
             break;
-
-            //for LED3 on/off
-        case SYSCALL_LED3_OFF: ioport_set_pin_level(IO1_LED3_PIN, LED_OFF);
+        case 2: ioport_set_pin_level(IO1_LED2_PIN, level);
             break;
-        case SYSCALL_LED3_ON: ioport_set_pin_level(IO1_LED3_PIN, LED_ON);
+        case 3: ioport_set_pin_level(IO1_LED3_PIN, level);
             break;
+        default:
+            return false;
+    }
+    return true;
+}
 
-        case SYSCALL_WRITECHARTOSCREEN:
-            ssd1306_set_page_address(0); //changes line number (0-3)
-            ssd1306_set_column_address(0); //change line position (128 pixels wide, you can choose 0-127)
-            ssd1306_write_text((char*) svc_args[0]);
-            break;
+int8_t batchRunOp(BatchOp* op) {
+    switch (op->op) {
+        case BATCH_LED:
+            return setLed(op->led, op->on) ? BATCH_DONE : BATCH_REFUSED;
+        case BATCH_TEXT:
+            return writeText((uint32_t) (uintptr_t) op->text, op->line, op->column) == 0 ? BATCH_DONE : BATCH_REFUSED;
+        case BATCH_CLEAR:
+            ssd1306_clear();
+            return BATCH_DONE;
+        case BATCH_GETTEMP:
+            if (!ARG_OBJECT((uint32_t) (uintptr_t) op->temperature, double)) {
+                badArgument();
+                return BATCH_REFUSED;
+            }
+            return at30tse_read_temperature(op->temperature) == 0 ? BATCH_DONE : BATCH_REFUSED;
+        default:
+            return BATCH_REFUSED;
+    }
+}
 
-        case SYSCALL_WRITESTRINGTOSCREEN:
-            ssd1306_set_page_address((int) svc_args[1]); //changes line number (0-3)
-            ssd1306_set_column_address(0); //change line position (128 pixels wide, you can choose 0-127)
-            ssd1306_write_text((char*) svc_args[0]);
-            break;
+/*
+ * Runs up to BATCH_MAX ops of the list in r0, r1 long, and returns how
+ * many it ran. A delay puts the thread to sleep, so it is the last op of
+ * the call.
+ */
+static uint32_t sysBatch(unsigned int* svc_args) {
+    BatchOp* ops = (BatchOp*) (uintptr_t) svc_args[0];
+    uint32_t count = svc_args[1];
+    uint32_t i;
+
+    if (count > BATCH_MAX)
+        count = BATCH_MAX;
+    if (count == 0 || !ARG_ARRAY(svc_args[0], BatchOp, count))
+        return badArgument();
+
+    for (i = 0; i < count; i++) {
+        BatchOp* op = &ops[i];
+
+        if (op->op == BATCH_DELAY) {
+            op->status = BATCH_DONE;
+            sleepCurrentThread(op->ms);
+            return i + 1;
+        }
+        op->status = batchRunOp(op);
+    }
+    return count;
+}
 
-        case SYSCALL_GETTEMP:
-            at30tse_read_temperature((double*) svc_args[0]);
-            break;
+/*
+ * Queues the request in r0 for the device thread, once its ops, event
+ * flags and callback check out. The device thread runs the callback
+ * privileged, so it gets the same check as an idle hook.
+ */
+static uint32_t sysDeviceSubmit(unsigned int* svc_args) {
+    DeviceRequest* req = (DeviceRequest*) (uintptr_t) svc_args[0];
 
-        case SYSCALL_GETLIGHT:
-            adc_value = adc_get_channel_value(ADC, ADC_CHANNEL_4);
-            break;
+    if (!ARG_OBJECT(svc_args[0], DeviceRequest))
+        return badArgument();
+    if (req->count == 0 || !ARG_ARRAY((uint32_t) (uintptr_t) req->ops, BatchOp, req->count)
+            || (req->done != NULL && (!ARG_OBJECT((uint32_t) (uintptr_t) req->done, EventFlags) || req->doneFlags == 0))
+            || (req->callback != NULL && !ARG_FUNCTION((uint32_t) (uintptr_t) req->callback)))
+        return badArgument();
 
-        case SYSCALL_WRITESTRINGTOSCREENPOSITION:
-            ssd1306_set_page_address((int) svc_args[1]); //changes line number (0-3)
-            ssd1306_set_column_address((int) svc_args[2]); //change line position (128 pixels wide, you can choose 0-127)
-            ssd1306_write_text((char*) svc_args[0]);
-            break;
+    return deviceQueue(req);
+}
 
-        case SYSCALL_DELAY:
-            delay_ms((int) svc_args[0]);
-            break;
+#ifdef SOS_SYSCALL_STATS
+extern volatile int currentThreadId;
 
-        case SYSCALL_CLEARSCREEN:
-            ssd1306_clear();
-            break;
+//Handlers don't nest, so only SVC_Switch and sysSyscallStats touch these
+static SyscallStats syscallCalls[NUM_OF_SYSCALLS];
 
-        default: 
-            ssd1306_set_page_address(0); //changes line number (0-3)
-            ssd1306_set_column_address(0); //change line position (128 pixels wide, you can choose 0-127)
-            ssd1306_write_text("Some SVC Error Happened");
-            break;
+static void syscallAccount(uint8_t code, int tid, uint32_t cycles) {
+    SyscallStats* s = &syscallCalls[code];
+
+    if (s->count == 0 || cycles < s->minCycles)
+        s->minCycles = cycles;
+    if (cycles > s->maxCycles)
+        s->maxCycles = cycles;
+    s->totalCycles += cycles;
+    s->count++;
+    s->lastThread = tid;
+}
+
+static uint32_t sysSyscallStats(unsigned int* svc_args) {
+    uint32_t number = svc_args[0];
+
+    if (number >= NUM_OF_SYSCALLS)
+        return SYSCALL_ERROR;
+    if (!ARG_OBJECT(svc_args[1], SyscallStats))
+        return badArgument();
+    if (syscallCalls[number].count == 0)
+        return 1;
+
+    *(SyscallStats*) (uintptr_t) svc_args[1] = syscallCalls[number];
+    return 0;
+}
+#endif
+
+//Indexed by the numbers of sysnums.h, the gaps are NULL
+static const SyscallHandler syscallTable[NUM_OF_SYSCALLS] = {
+    [SYSCALL_LED0_OFF] = sysLed0Off,
+    [SYSCALL_LED0_ON] = sysLed0On,
+    [SYSCALL_LED1_OFF] = sysLed1Off,
+    [SYSCALL_LED1_ON] = sysLed1On,
+    [SYSCALL_LED2_OFF] = sysLed2Off,
+    [SYSCALL_LED2_ON] = sysLed2On,
+    [SYSCALL_LED3_OFF] = sysLed3Off,
+    [SYSCALL_LED3_ON] = sysLed3On,
+    [SYSCALL_GETTEMP] = sysGetTemp,
+    [SYSCALL_GETLIGHT] = sysGetLight,
+    [SYSCALL_WRITECHARTOSCREEN] = sysWriteCharToScreen,
+    [SYSCALL_WRITESTRINGTOSCREEN] = sysWriteStringToScreen,
+    [SYSCALL_WRITESTRINGTOSCREENPOSITION] = sysWriteStringToScreenPosition,
+    [SYSCALL_DELAY] = sysDelay,
+    [SYSCALL_CLEARSCREEN] = sysClearScreen,
+    [SYSCALL_YIELD] = sysYield,
+    [SYSCALL_EXIT] = sysExit,
+    [SYSCALL_JOIN] = sysJoin,
+    [SYSCALL_DETACH] = sysDetach,
+    [SYSCALL_THREADSTATS] = sysThreadStats,
+    [SYSCALL_DUMPTHREADSTATS] = sysDumpThreadStats,
+    [SYSCALL_MUTEX_LOCK] = sysMutexLock,
+    [SYSCALL_MUTEX_UNLOCK] = sysMutexUnlock,
+    [SYSCALL_SEM_WAIT] = sysSemWait,
+    [SYSCALL_SEM_POST] = sysSemPost,
+    [SYSCALL_EVENT_WAIT] = sysEventWait,
+    [SYSCALL_EVENT_SET] = sysEventSet,
+    [SYSCALL_TIMER_START] = sysTimerStart,
+    [SYSCALL_TIMER_STOP] = sysTimerStop,
+    [SYSCALL_PERIODIC_START] = sysPeriodicStart,
+    [SYSCALL_PERIODIC_WAIT] = sysPeriodicWait,
+    [SYSCALL_IDLE_HOOK] = sysIdleHook,
+    [SYSCALL_BATCH] = sysBatch,
+    [SYSCALL_DEVICE_SUBMIT] = sysDeviceSubmit,
+#ifdef SOS_SYSCALL_STATS
+    [SYSCALL_SYSCALLSTATS] = sysSyscallStats,
+#endif
+};
+
+/*  
+ * Runs the syscall whose number is the immediate of the svc instruction,
+ * the halfword before the stacked pc, and leaves its result in the
+ * stacked r0. An unknown number returns SYSCALL_ERROR.
+ */
+void SVC_Switch(unsigned int * svc_args) {
+    uint8_t code = ((uint8_t *) (uintptr_t) svc_args[6])[-2];
+
+    TRACE(TRACE_SVC, code);
+
+    if (code >= NUM_OF_SYSCALLS || syscallTable[code] == NULL) {
+        svc_args[0] = badArgument();
+        return;
     }
+
+#ifdef SOS_SYSCALL_STATS
+    int tid = currentThreadId;
+    uint32_t start = cpu_cycle_counter_read();
+
+    svc_args[0] = syscallTable[code](svc_args);
+    syscallAccount(code, tid, cpu_cycles_since(start));
+#else
+    svc_args[0] = syscallTable[code](svc_args);
+#endif
 }
 
 /*  
@@ -147,75 +452,28 @@ void SVC_Error(int ledNum) {
 //////////////////////////////////////////////////////////////////////////
 
 
-//declaration of callback function
-void (*pTimerCallback) (void);
+//The RTT belongs to the timer service, the MOSTimer is one of its timers
+static SoftTimer mosTimer;
+static void (*pTimerCallback) (void);
 
-RAMFUNC;
+static void MOSTimerExpired(void* arg) {
+    pTimerCallback();
+}
 
 void MOSTimerSet(int tickPeriodMs, void (*pFunc) (void)) {
-
     //registers the callback function
     pTimerCallback = pFunc;
-
-
-    // Sets the RTT to generate a tick which triggers
-    // the Real-Time Increment Interrupt (RTTINC)
-
-    // The prescaler period (the tick) is equal to:
-    //               tickPeriod * SCLK period.
-    //			=>  (tickPeriodMs/1000) * SCLK Period
-
-    // Slow Clock (SCLK) = 32Khz (Generated by the Crystal or RC OScillator)
-    // Max prescaler value (tickePeriod) is 2^16 = 65536
-    //			=> Max tickPeriod = 2 seconds
-    uint32_t ul_previous_time;
-
-    rtt_sel_source(RTT, false); //source is not rtc
-    rtt_init(RTT, (int) (((double) tickPeriodMs / (double) 1000) * BOARD_FREQ_SLCK_XTAL)); //Configure tick time
-
-    //Not sure why this has to be here... but I'll leave it
-    //Looks as it's waiting for 1 tick to occur
-    //Check this later....
-    ul_previous_time = rtt_read_timer_value(RTT);
-    while (ul_previous_time == rtt_read_timer_value(RTT));
-
-    //Clear previous on-going ints?
-    NVIC_DisableIRQ(RTT_IRQn);
-    NVIC_ClearPendingIRQ(RTT_IRQn);
-    //Sets new int
-    NVIC_SetPriority(RTT_IRQn, 0);
-    NVIC_EnableIRQ(RTT_IRQn);
-    rtt_enable_interrupt(RTT, RTT_MR_RTTINCIEN);
-}
-
-RAMFUNC;
-
-void RTT_Handler(void) {
-    uint32_t ul_status;
-
-    //get rtt status
-    ul_status = rtt_get_status(RTT);
-
-    //Check whether the Timer has been incremented since the last read
-    if ((ul_status & RTT_SR_RTTINC) == RTT_SR_RTTINC) {
-        //It doesn't mutates any register!!
-        //Why do we need this if-statement then? I dont know!!
-        //but if we dont have it, the USB communication dies...	
-        pTimerCallback();
-    }
+    softTimerInit(&mosTimer, &MOSTimerExpired, NULL);
+    softTimerStart(&mosTimer, tickPeriodMs * 1000, tickPeriodMs * 1000);
 }
 
 void MOSTimerStop(void) {
-    //Not too sure the different between rtt_disable and NVUC_Disable IRQ
-    //Check this later....
-    NVIC_DisableIRQ(RTT_IRQn);
-    NVIC_ClearPendingIRQ(RTT_IRQn);
-
-    rtt_disable_interrupt(RTT, RTT_MR_RTTINCIEN);
+    softTimerStop(&mosTimer);
 }
 
+//RTT counts since the scheduler started
 long int MOSTimerRead(void) {
-    return rtt_read_timer_value(RTT);
+    return rttNow();
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -254,6 +512,8 @@ void MOSDelaySecs(int timeS) {
 
 static bool my_flag_autorize_cdc_transfert = false;
 
+RING_DEFINE(stdin_bytes, char, 64);
+
 mResult MOSOpenStdio(mStdioType type) {
     switch (type) {
         case STDIO_USB_CDC: udc_start();
@@ -275,28 +535,124 @@ mResult MOSCloseStdio(mStdioType type) {
 
 mResult MOSPutc(char c) {
     if (my_flag_autorize_cdc_transfert) {
-        while (!udi_cdc_is_tx_ready); //waits till tx is ready
+        while (!udi_cdc_is_tx_ready()); //waits till tx is ready
         return udi_cdc_putc(c) ? MOS_OK : MOS_ERROR_STDIO;
     }
     return MOS_ERROR_STDIO;
 }
 
+//The reads block the calling thread, so they can't be used from handlers
+
 char MOSGetc(void) {
-    return udi_cdc_getc(); //Halts till a character is received
+    char c;
+
+    ringReceive(&stdin_bytes, &c, WAIT_FOREVER); //Sleeps till a character is received
+    return c;
 }
 
 bool MOSReceivedChar(void) {
-    return udi_cdc_is_rx_ready();
+    return ringCount(&stdin_bytes) > 0;
 }
 
 void MOSRead(char* buf, int bufSz) {
-    udi_cdc_read_buf(buf, bufSz); //Halts till bufSz characters are received	
+    while (bufSz-- > 0) //Sleeps till bufSz characters are received
+        *buf++ = MOSGetc();
 }
 
 void MOSWrite(const char* buf, int bufSz) {
     udi_cdc_write_buf(buf, bufSz);
 }
 
+/*
+ * Writes all of buf if the tx buffer has room for it right now, otherwise
+ * nothing. Never waits on the host.
+ */
+bool MOSTryWrite(const char* buf, int bufSz) {
+    if (!my_flag_autorize_cdc_transfert || udi_cdc_get_free_tx_buffer() < bufSz)
+        return false;
+    MOSWrite(buf, bufSz);
+    return true;
+}
+
+/*
+ * Writes a table of the cpu accounting of every thread: run and ready time
+ * in ms, sleep time in ticks. A line that doesn't fit in the tx buffer ends
+ * the dump, waiting for room would need the USB interrupt, which can't
+ * preempt an SVC.
+ */
+void MOSDumpThreadStats(void) {
+    ThreadStats s;
+    char line[128];
+    uint32_t cyclesPerMs = sysclk_get_cpu_hz() / 1000;
+    int tid, len, found;
+#ifdef SOS_SYSCALL_STATS
+    int code;
+#endif
+
+    if (!my_flag_autorize_cdc_transfert)
+        return;
+
+    len = sprintf(line, "cpu load %d.%d%%\r\n", cpuLoad() / 10, cpuLoad() % 10);
+    if (udi_cdc_get_free_tx_buffer() < len)
+        return;
+    MOSWrite(line, len);
+
+    len = sprintf(line, "tid name          pri st  switches   run_ms ready_ms sleep_tk   stack\r\n");
+    if (udi_cdc_get_free_tx_buffer() < len)
+        return;
+    MOSWrite(line, len);
+
+    for (tid = 0; (found = getThreadStats(tid, &s)) >= 0; tid++) {
+        if (found != 0)
+            continue;
+
+        len = sprintf(line, "%3d %-13.13s %3u %2u %9" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %3u/%3u\r\n", tid, s.name,
+                s.priority, s.state, s.switches, (uint32_t) (s.runCycles / cyclesPerMs),
+                (uint32_t) (s.readyCycles / cyclesPerMs), s.sleepTicks, s.stackPeak, s.stackWords);
+        if (udi_cdc_get_free_tx_buffer() < len)
+            return;
+        MOSWrite(line, len);
+    }
+
+    //then the deadlines of the periodic ones
+    len = sprintf(line, "tid name          period_us     jobs   missed  overrun max_lat_us\r\n");
+    if (udi_cdc_get_free_tx_buffer() < len)
+        return;
+    MOSWrite(line, len);
+
+    for (tid = 0; (found = getThreadStats(tid, &s)) >= 0; tid++) {
+        if (found != 0 || s.periodUs == 0)
+            continue;
+
+        len = sprintf(line, "%3d %-13.13s %9" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %10" PRIu32 "\r\n", tid, s.name, s.periodUs,
+                s.jobs, s.deadlineMisses, s.budgetOverruns, s.maxLatencyCycles / (cyclesPerMs / 1000));
+        if (udi_cdc_get_free_tx_buffer() < len)
+            return;
+        MOSWrite(line, len);
+    }
+
+#ifdef SOS_SYSCALL_STATS
+    //and the syscalls made so far, times in cycles
+    len = sprintf(line, "svc    calls      avg      min      max last_tid\r\n");
+    if (udi_cdc_get_free_tx_buffer() < len)
+        return;
+    MOSWrite(line, len);
+
+    for (code = 0; code < NUM_OF_SYSCALLS; code++) {
+        SyscallStats* c = &syscallCalls[code];
+
+        if (c->count == 0)
+            continue;
+
+        len = sprintf(line, "%3d %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8d\r\n", code, c->count,
+                (uint32_t) (c->totalCycles / c->count), c->minCycles, c->maxCycles, c->lastThread);
+        if (udi_cdc_get_free_tx_buffer() < len)
+            return;
+        MOSWrite(line, len);
+    }
+#endif
+}
+
 //These functions are specific to the USB Stack implementation
 //------------------------------------------------------------
 
@@ -309,6 +665,16 @@ void my_callback_cdc_disable(void) {
     my_flag_autorize_cdc_transfert = false;
 }
 
+//Runs in the USB interrupt, moves what arrived into stdin_bytes
+void my_callback_rx_notify(uint8_t port) {
+    char c;
+
+    while (udi_cdc_is_rx_ready()) {
+        c = udi_cdc_getc();
+        ringSend(&stdin_bytes, &c);
+    }
+}
+
 void user_callback_vbus_action(bool b_high) {
     if (b_high) {
         // Attach USB Device
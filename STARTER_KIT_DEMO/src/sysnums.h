@@ -26,5 +26,73 @@
 #define SYSCALL_WRITESTRINGTOSCREENPOSITION 20
 #define SYSCALL_DELAY			21
 #define SYSCALL_CLEARSCREEN			22
+#define SYSCALL_YIELD			23
+#define SYSCALL_EXIT			24
+#define SYSCALL_JOIN			25
+#define SYSCALL_DETACH			26
+#define SYSCALL_THREADSTATS		27
+#define SYSCALL_DUMPTHREADSTATS	28
+#define SYSCALL_MUTEX_LOCK		29
+#define SYSCALL_MUTEX_UNLOCK	30
+#define SYSCALL_SEM_WAIT		31
+#define SYSCALL_SEM_POST		32
+#define SYSCALL_EVENT_WAIT		33
+#define SYSCALL_EVENT_SET		34
+#define SYSCALL_TIMER_START		35
+#define SYSCALL_TIMER_STOP		36
+#define SYSCALL_PERIODIC_START	37
+#define SYSCALL_PERIODIC_WAIT	38
+#define SYSCALL_IDLE_HOOK		39
+#define SYSCALL_BATCH			40
+#define SYSCALL_SYSCALLSTATS	41
+#define SYSCALL_DEVICE_SUBMIT	42
+
+//One past the highest number, the size of the kernel's table
+#define NUM_OF_SYSCALLS			43
+
+//What a syscall returns in r0 for an unknown number or a bad argument
+#define SYSCALL_ERROR			0xFFFFFFFFUL
+
+#ifdef SOS_HOST
+
+//The host port has no SVC instruction, hostSvc runs SVC_Switch on a frame
+//laid out like the one the hardware stacks
+uint32_t hostSvc(uint8_t code, uint32_t r0, uint32_t r1, uint32_t r2, uint32_t r3);
+
+#define svc(code) hostSvc((code), 0, 0, 0, 0)
+#define svc_r0(code, arg) hostSvc((code), (uint32_t) (uintptr_t) (arg), 0, 0, 0)
+#define svc_r0_r1(code, arg0, arg1) hostSvc((code), (uint32_t) (uintptr_t) (arg0), (uint32_t) (uintptr_t) (arg1), 0, 0)
+#define svc_r0_r3(code, arg0, arg1, arg2, arg3) hostSvc((code), (uint32_t) (uintptr_t) (arg0), \
+	(uint32_t) (uintptr_t) (arg1), (uint32_t) (uintptr_t) (arg2), (uint32_t) (uintptr_t) (arg3))
+
+#else
+
+//Issues an SVC without arguments. The kernel leaves its result in r0, the
+//calls that take arguments use the macros below
+#define svc(code) asm volatile ("svc %[immediate]"::[immediate] "I" (code) : "r0", "memory")
+
+//Issues an SVC with arg in r0 and evaluates to what the kernel left in r0
+#define svc_r0(code, arg) ({ \
+	register uint32_t r0 asm("r0") = (uint32_t) (arg); \
+	asm volatile ("svc %[immediate]" : "+r" (r0) : [immediate] "I" (code) : "memory"); \
+	r0; })
+
+//Same with a second argument in r1
+#define svc_r0_r1(code, arg0, arg1) ({ \
+	register uint32_t r0 asm("r0") = (uint32_t) (arg0); \
+	register uint32_t r1 asm("r1") = (uint32_t) (arg1); \
+	asm volatile ("svc %[immediate]" : "+r" (r0) : [immediate] "I" (code), "r" (r1) : "memory"); \
+	r0; })
+
+//And with four arguments in r0-r3
+#define svc_r0_r3(code, arg0, arg1, arg2, arg3) ({ \
+	register uint32_t r0 asm("r0") = (uint32_t) (arg0); \
+	register uint32_t r1 asm("r1") = (uint32_t) (arg1); \
+	register uint32_t r2 asm("r2") = (uint32_t) (arg2); \
+	register uint32_t r3 asm("r3") = (uint32_t) (arg3); \
+	asm volatile ("svc %[immediate]" : "+r" (r0) : [immediate] "I" (code), "r" (r1), "r" (r2), "r" (r3) : "memory"); \
+	r0; })
+
+#endif
 
 #endif /* SYSNUMS_H_ */
\ No newline at end of file
@@ -0,0 +1,98 @@
+/*
+ * Threads
+ *
+ * User-level thread calls. Threads run unprivileged, so these
+ * ask the kernel via SVCs.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include "sysnums.h"
+#include "threads.h"
+
+/*
+ * Ends the calling thread. Also where a thread returning from its
+ * start function ends up, the kernel sets it as its lr.
+ */
+void exitThread(void) {
+    svc(SYSCALL_EXIT);
+
+    //the kernel never switches back to an exited thread
+    while (1);
+}
+
+/*
+ * Waits for thread tid to exit and frees it. Returns 0, or -1 if tid
+ * doesn't exist, is detached or is already being joined.
+ */
+int joinThread(int tid) {
+    return (int) svc_r0(SYSCALL_JOIN, tid);
+}
+
+/*
+ * Lets thread tid be freed as soon as it exits, without a join.
+ */
+int detachThread(int tid) {
+    return (int) svc_r0(SYSCALL_DETACH, tid);
+}
+
+/*
+ * Id of the calling thread. The kernel keeps it in a global on every
+ * switch, so no SVC is needed.
+ */
+int threadSelf(void) {
+    extern volatile int currentThreadId;
+
+    return currentThreadId;
+}
+
+/*
+ * The kernel works it out once a second, so no SVC is needed.
+ */
+int cpuLoad(void) {
+    extern volatile uint16_t cpuLoadPermille;
+
+    return cpuLoadPermille;
+}
+
+int idleHook(IdleHook hook) {
+    return (int) svc_r0(SYSCALL_IDLE_HOOK, hook);
+}
+
+/*
+ * Fills stats with the cpu accounting of thread tid. Returns 0, 1 if
+ * there is no thread in that slot or -1 once tid is past the last one.
+ */
+int threadStats(int tid, ThreadStats* stats) {
+    return (int) svc_r0_r1(SYSCALL_THREADSTATS, tid, stats);
+}
+
+int syscallStats(int number, SyscallStats* stats) {
+    return (int) svc_r0_r1(SYSCALL_SYSCALLSTATS, number, stats);
+}
+
+/*
+ * Writes the cpu accounting of every thread to the USB CDC stdio, and the
+ * syscall counts with SOS_SYSCALL_STATS.
+ */
+void dumpThreadStats(void) {
+    svc(SYSCALL_DUMPTHREADSTATS);
+}
+
+int periodicStart(uint32_t periodUs, uint32_t deadlineUs, uint32_t budgetUs) {
+    return (int) svc_r0_r3(SYSCALL_PERIODIC_START, periodUs, deadlineUs, budgetUs, 0);
+}
+
+void periodicStop(void) {
+    periodicStart(0, 0, 0);
+}
+
+/*
+ * The kernel stores the result before blocking, it comes back in r0 at
+ * the next release.
+ */
+int periodicWait(void) {
+    return (int) svc_r0(SYSCALL_PERIODIC_WAIT, 0);
+}
\ No newline at end of file
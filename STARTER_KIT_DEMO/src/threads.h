@@ -11,11 +11,81 @@
 #ifndef THREADS_H_
 #define THREADS_H_
 
-// As of now, implementation is in scheduler.c
-// which is system software. Ideally, we need a user-level code
-// in a file named thread.c (to keep consistency with naming of other files)
-// that call functions from scheduler.c via SVCs
+// createThread is implemented in scheduler.c, which is system software,
+// so it can only be called from privileged code. The rest is user-level
+// code in threads.c that calls functions from scheduler.c via SVCs
 
 int createThread(  void (*startAddress) (void), char* name, int stackSize );
+int createThreadEx(  void (*startAddress) (void), char* name, int stackSize, uint8_t priority, uint32_t quantumMs );
+
+//Cpu accounting of one thread, filled in by threadStats
+typedef struct{
+	char* name;
+	uint8_t state;
+	uint8_t priority;
+	uint32_t switches;			//times it was switched in
+	uint32_t sleepTicks;		//ticks spent sleeping or blocked
+	uint16_t stackWords;		//usable size of its stack
+	uint16_t stackPeak;			//most of it ever used, in words
+	uint64_t runCycles;			//cycles spent running
+	uint64_t readyCycles;		//cycles spent waiting for the cpu
+	uint64_t uptimeCycles;		//cycles since the scheduler started, for all threads
+	
+	//periodic threads only, 0 for the others
+	uint32_t periodUs;
+	uint32_t jobs;				//releases so far
+	uint32_t deadlineMisses;	//jobs that finished late or were skipped
+	uint32_t budgetOverruns;	//jobs throttled for running past their budget
+	uint32_t maxLatencyCycles;	//longest from a release until it got the cpu
+}ThreadStats;
+
+//Calls of one syscall, filled in by syscallStats. The cycles are those of
+//its handler, from the cycle counter, without the exception entry and exit
+typedef struct{
+	uint32_t count;
+	uint32_t minCycles;
+	uint32_t maxCycles;
+	uint64_t totalCycles;
+	int lastThread;				//id of the thread that made the last call
+}SyscallStats;
+
+// Background work for the idle thread, run whenever no thread is ready,
+// before the cpu goes to sleep. Runs privileged and must not block; it
+// returns true if it has more to do, which keeps the cpu awake
+typedef bool (*IdleHook)(void);
+
+// Ends the calling thread. Mutexes it still owns should be unlocked
+// first: the ones other threads wait on are handed to them, the others
+// stay locked
+void exitThread( void ) __attribute__((noreturn));
+int joinThread( int tid );
+int detachThread( int tid );
+int threadStats( int tid, ThreadStats* stats );
+int threadSelf( void );
+void dumpThreadStats( void );
+
+// Fills stats with the calls of syscall number (see sysnums.h). Returns 0,
+// 1 if it was never called or -1 once number is past the last one.
+// Needs SOS_SYSCALL_STATS, without it always returns -1
+int syscallStats( int number, SyscallStats* stats );
+
+// Cpu used by threads over the last second, in tenths of a percent. Idle
+// hooks count as used
+int cpuLoad( void );
+
+// Adds a hook to the idle thread. Returns 0, or -1 if IDLE_HOOKS_MAX are
+// in already
+int idleHook( IdleHook hook );
+
+// Makes the calling thread periodic, its first job released right away.
+// deadlineUs is from each release, 0 for the period; budgetUs is the cpu
+// time a job may use, 0 for no limit. A period of 0 makes it a plain
+// thread again. Returns 0, or -1 if RT_MAX_TASKS threads are periodic
+int periodicStart( uint32_t periodUs, uint32_t deadlineUs, uint32_t budgetUs );
+void periodicStop( void );
+
+// Ends the current job and waits for the next release. Returns the number
+// of deadlines missed since the last call
+int periodicWait( void );
 
 #endif /* THREADS_H_ */
\ No newline at end of file
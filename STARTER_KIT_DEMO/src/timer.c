@@ -0,0 +1,228 @@
+/*
+ * Software timers
+ *
+ * Running timers are kept in a list sorted by expiry. The RTT interrupt
+ * only wakes the daemon up; the daemon takes the expired timers off the
+ * list, runs their callbacks and puts periodic ones back in. The tickless
+ * idle shares the alarm through rttArm, so it never sleeps past a timer.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include "minios.h"
+#include "sysnums.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "timer.h"
+#include "trace.h"
+
+#define TIMER_DAEMON_STACK_SIZE		256
+
+//true while in an interrupt or exception handler
+#define IN_HANDLER() (__get_IPSR() != 0)
+
+static SoftTimer* timerHead = NULL;
+static Semaphore timerWake = SEMAPHORE_INIT(0);
+
+/*
+ * Current RTT count. The counter runs on the slow clock, so it is read
+ * until two reads agree.
+ */
+uint32_t rttNow(void){
+	uint32_t count;
+	
+	do {
+		count = RTT->RTT_VR;
+	} while (count != RTT->RTT_VR);
+	return count;
+}
+
+/*
+ * Sets the RTT alarm at count, or at the first timer if that is earlier.
+ * The alarm only goes off when the counter gets to it, so if that already
+ * happened the interrupt is raised here.
+ */
+void rttArm(uint32_t count){
+	if (timerHead != NULL && RTT_BEFORE(timerHead->expiry, count))
+		count = timerHead->expiry;
+	
+	rtt_disable_interrupt(RTT, RTT_MR_ALMIEN);
+	rtt_write_alarm_time(RTT, (count != 0) ? count : 1);
+	rtt_enable_interrupt(RTT, RTT_MR_ALMIEN);
+	
+	if (!RTT_BEFORE(rttNow(), count))
+		NVIC_SetPendingIRQ(RTT_IRQn);
+}
+
+/*
+ * Sets the RTT alarm for the first timer, or turns it off.
+ */
+void timerRearm(void){
+	if (timerHead != NULL)
+		rttArm(timerHead->expiry);
+	else
+		rtt_disable_interrupt(RTT, RTT_MR_ALMIEN);
+}
+
+static void timerInsert(SoftTimer* t){
+	SoftTimer** link = &timerHead;
+	
+	while (*link != NULL && !RTT_BEFORE(t->expiry, (*link)->expiry))
+		link = &(*link)->next;
+	
+	t->next = *link;
+	*link = t;
+}
+
+static void timerRemove(SoftTimer* t){
+	SoftTimer** link = &timerHead;
+	
+	while (*link != NULL && *link != t)
+		link = &(*link)->next;
+	if (*link != NULL)
+		*link = t->next;
+	t->next = NULL;
+}
+
+/*
+ * Moves the expiry of periodic timer t one period on. The expiry is kept
+ * in us from a base count, so the rounding of one period to RTT counts
+ * isn't carried into the next; the base moves on by whole counts.
+ */
+static void timerAdvance(SoftTimer* t){
+	t->phase += t->period;
+	t->base += (t->phase / RTT_EXACT_US) * US_TO_RTT(RTT_EXACT_US);
+	t->phase %= RTT_EXACT_US;
+	t->expiry = t->base + US_TO_RTT(t->phase);
+}
+
+/*
+ * Starts t, or restarts it if it is running. Delays and periods shorter
+ * than one RTT count are rounded up to one.
+ */
+void startTimer(SoftTimer* t, uint32_t delayUs, uint32_t periodUs){
+	irqflags_t flags = cpu_irq_save();
+	uint32_t delay = US_TO_RTT(delayUs);
+	
+	if (t->active)
+		timerRemove(t);
+	
+	t->expiry = rttNow() + ((delay != 0) ? delay : 1);
+	t->base = t->expiry;
+	t->phase = 0;
+	t->period = periodUs;
+	if (periodUs != 0 && US_TO_RTT(periodUs) == 0)
+		t->period = RTT_TO_US(1) + 1;
+	t->active = true;
+	timerInsert(t);
+	
+	if (timerHead == t)
+		timerRearm();
+	
+	cpu_irq_restore(flags);
+}
+
+void stopTimer(SoftTimer* t){
+	irqflags_t flags = cpu_irq_save();
+	
+	if (t->active){
+		bool first = (timerHead == t);
+		
+		timerRemove(t);
+		t->active = false;
+		if (first)
+			timerRearm();
+	}
+	
+	cpu_irq_restore(flags);
+}
+
+/*
+ * Kernel thread that runs the callbacks of expired timers. Callbacks run
+ * with interrupts enabled, and may start and stop timers themselves.
+ */
+static void timerDaemon(void){
+	irqflags_t flags;
+	SoftTimer* t;
+	
+	while (1){
+		semWait(&timerWake, WAIT_FOREVER);
+		
+		flags = cpu_irq_save();
+		while (timerHead != NULL && !RTT_BEFORE(rttNow(), timerHead->expiry)){
+			t = timerHead;
+			timerHead = t->next;
+			
+			if (t->period != 0){
+				timerAdvance(t);
+				timerInsert(t);
+			} else {
+				t->active = false;
+			}
+			
+			cpu_irq_restore(flags);
+			t->callback(t->arg);
+			flags = cpu_irq_save();
+		}
+		timerRearm();
+		cpu_irq_restore(flags);
+	}
+}
+
+/*
+ * Starts the RTT counting and the timer daemon, along with the scheduler.
+ */
+void timerServiceInit(void){
+	rtt_sel_source(RTT, false);
+	rtt_init(RTT, RTT_PRESCALER);
+	
+	NVIC_DisableIRQ(RTT_IRQn);
+	NVIC_ClearPendingIRQ(RTT_IRQn);
+	NVIC_SetPriority(RTT_IRQn, 0);
+	NVIC_EnableIRQ(RTT_IRQn);
+	
+	createKernelThread(&timerDaemon, "timers ", TIMER_DAEMON_STACK_SIZE, PRIORITY_HIGHEST);
+}
+
+/*
+ * The alarm went off, either for a timer or to end a tickless sleep, which
+ * the interrupt itself already did.
+ */
+void RTT_Handler(void){
+	TRACE(TRACE_ISR_ENTER, RTT_IRQn + 16);
+	
+	//reading the status clears the alarm
+	rtt_get_status(RTT);
+	
+	if (timerHead != NULL && !RTT_BEFORE(rttNow(), timerHead->expiry))
+		postSemaphore(&timerWake);
+	
+	TRACE(TRACE_ISR_EXIT, RTT_IRQn + 16);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//							USER-LEVEL CALLS							//
+//////////////////////////////////////////////////////////////////////////
+
+void softTimerInit(SoftTimer* t, TimerCallback callback, void* arg){
+	t->callback = callback;
+	t->arg = arg;
+	t->active = false;
+	t->next = NULL;
+}
+
+void softTimerStart(SoftTimer* t, uint32_t delayUs, uint32_t periodUs){
+	if (IN_HANDLER())
+		startTimer(t, delayUs, periodUs);
+	else
+		svc_r0_r3(SYSCALL_TIMER_START, t, delayUs, periodUs, 0);
+}
+
+void softTimerStop(SoftTimer* t){
+	if (IN_HANDLER())
+		stopTimer(t);
+	else
+		svc_r0(SYSCALL_TIMER_STOP, t);
+}
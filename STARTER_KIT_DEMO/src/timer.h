@@ -0,0 +1,64 @@
+/*
+ * Software timers
+ *
+ * Any number of one-shot and periodic timers on top of the RTT. The RTT
+ * counts freely from the start of the scheduler and its alarm is set for
+ * whichever timer expires first. Callbacks run in the timer daemon thread,
+ * not in the interrupt, so they may block or take time. The resolution is
+ * one RTT count, about 92 us.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//The RTT counts in steps of 3 slow clock periods, the smallest prescaler
+#define RTT_PRESCALER		3
+#define US_TO_RTT(us) ((uint32_t) (((uint64_t) (us) * BOARD_FREQ_SLCK_XTAL) / (RTT_PRESCALER * 1000000ULL)))
+#define RTT_TO_US(c) ((uint32_t) (((uint64_t) (c) * RTT_PRESCALER * 1000000ULL) / BOARD_FREQ_SLCK_XTAL))
+//A whole number of RTT counts
+#define RTT_EXACT_US		(RTT_PRESCALER * 1000000UL)
+//Rounded up, for alarms that must not go off early
+#define US_TO_RTT_UP(us) ((uint32_t) (((uint64_t) (us) * BOARD_FREQ_SLCK_XTAL + RTT_PRESCALER * 1000000ULL - 1) \
+	/ (RTT_PRESCALER * 1000000ULL)))
+
+//True if RTT count a comes before b, across the wrap around
+#define RTT_BEFORE(a, b) ((int32_t) ((a) - (b)) < 0)
+
+typedef void (*TimerCallback)(void* arg);
+
+typedef struct SoftTimer{
+	TimerCallback callback;
+	void* arg;
+	uint32_t expiry;			//RTT count it expires at
+	uint32_t base;				//RTT count the phase is from
+	uint32_t phase;				//us from base to the expiry
+	uint32_t period;			//in us, 0 for one-shot
+	bool active;
+	struct SoftTimer* next;		//next timer to expire
+}SoftTimer;
+
+// Kernel side
+void timerServiceInit(void);
+uint32_t rttNow(void);
+void rttArm(uint32_t);
+void timerRearm(void);
+void startTimer(SoftTimer*, uint32_t, uint32_t);
+void stopTimer(SoftTimer*);
+
+// Sets the callback of a timer that isn't running
+void softTimerInit( SoftTimer* t, TimerCallback callback, void* arg );
+
+// Runs the callback of t in delayUs, then every periodUs unless that is 0.
+// Each expiry is rounded to an RTT count on its own, so the rounding
+// doesn't add up. Restarts t if it is running. Callable from interrupt
+// handlers
+void softTimerStart( SoftTimer* t, uint32_t delayUs, uint32_t periodUs );
+void softTimerStop( SoftTimer* t );
+
+#endif /* TIMER_H_ */
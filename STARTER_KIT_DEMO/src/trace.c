@@ -0,0 +1,148 @@
+/*
+ * Scheduler trace
+ *
+ * The stream is a sequence of frames, each starting with 'T' 'R', a kind
+ * and a count byte:
+ *   TRACE_FRAME_RECORDS	count records of 8 bytes, as in TraceRecord
+ *   TRACE_FRAME_LOST		a uint32_t of records overwritten before they were sent
+ *   TRACE_FRAME_NAME		count is a thread id, 16 bytes of its name follow
+ *   TRACE_FRAME_CLOCK		a uint32_t of cpu Hz follows
+ * all little endian. Thread names and the clock go out every second, so the
+ * decoder can be started at any time.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "minios.h"
+#include "sysnums.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#ifdef SOS_TRACE
+
+#define TRACE_STACK_SIZE		256
+#define TRACE_FLUSH_MS			20
+#define TRACE_NAMES_EVERY		50		//flushes between two name tables
+#define TRACE_FRAME_MAX			32		//records in one frame
+#define TRACE_NAME_LEN			16
+
+#define TRACE_FRAME_RECORDS		0
+#define TRACE_FRAME_LOST		1
+#define TRACE_FRAME_NAME		2
+#define TRACE_FRAME_CLOCK		3
+
+bool MOSTryWrite(const char*, int);
+
+TraceRecord traceRing[TRACE_ENTRIES];
+volatile uint32_t traceHead = 0;
+
+static uint32_t traceTail = 0;
+static uint32_t traceLost = 0;
+
+static void frameHeader(uint8_t* frame, uint8_t kind, uint8_t count){
+	frame[0] = 'T';
+	frame[1] = 'R';
+	frame[2] = kind;
+	frame[3] = count;
+}
+
+/*
+ * Sends the name of every thread and the cpu clock.
+ */
+static void traceSendNames(void){
+	uint8_t frame[4 + TRACE_NAME_LEN];
+	uint32_t hz = sysclk_get_cpu_hz();
+	ThreadStats s;
+	int tid, found;
+	
+	frameHeader(frame, TRACE_FRAME_CLOCK, 0);
+	memcpy(frame + 4, &hz, sizeof(hz));
+	if (!MOSTryWrite((char*) frame, 4 + sizeof(hz)))
+		return;
+	
+	for (tid = 0; (found = getThreadStats(tid, &s)) >= 0 && tid < 0xFF; tid++){
+		if (found != 0)
+			continue;
+		
+		frameHeader(frame, TRACE_FRAME_NAME, tid);
+		memset(frame + 4, 0, TRACE_NAME_LEN);
+		memcpy(frame + 4, s.name, strnlen(s.name, TRACE_NAME_LEN));
+		if (!MOSTryWrite((char*) frame, sizeof(frame)))
+			return;
+	}
+}
+
+/*
+ * Sends what was recorded since the last flush, as long as the CDC has
+ * room for it. What doesn't fit stays in the ring for the next flush.
+ */
+static void traceFlush(void){
+	uint8_t frame[4 + TRACE_FRAME_MAX * sizeof(TraceRecord)];
+	uint32_t head, count, i;
+	
+	while (1){
+		head = traceHead;
+		
+		//the recorder lapped the stream
+		if (head - traceTail > TRACE_ENTRIES){
+			traceLost += head - traceTail - TRACE_ENTRIES;
+			traceTail = head - TRACE_ENTRIES;
+		}
+		
+		if (traceLost != 0){
+			frameHeader(frame, TRACE_FRAME_LOST, 0);
+			memcpy(frame + 4, &traceLost, sizeof(traceLost));
+			if (!MOSTryWrite((char*) frame, 4 + sizeof(traceLost)))
+				return;
+			traceLost = 0;
+		}
+		
+		count = head - traceTail;
+		if (count == 0)
+			return;
+		if (count > TRACE_FRAME_MAX)
+			count = TRACE_FRAME_MAX;
+		
+		for (i = 0; i < count; i++)
+			memcpy(frame + 4 + i * sizeof(TraceRecord), &traceRing[(traceTail + i) & (TRACE_ENTRIES - 1)], sizeof(TraceRecord));
+		
+		//records overwritten while they were copied are lost, not sent
+		head = traceHead;
+		if (head - traceTail > TRACE_ENTRIES){
+			traceLost += head - traceTail - TRACE_ENTRIES;
+			traceTail = head - TRACE_ENTRIES;
+			continue;
+		}
+		
+		frameHeader(frame, TRACE_FRAME_RECORDS, count);
+		if (!MOSTryWrite((char*) frame, 4 + count * sizeof(TraceRecord)))
+			return;
+		traceTail += count;
+	}
+}
+
+/*
+ * Kernel thread that streams the trace. It runs below the application
+ * threads, so it only takes what would otherwise be idle time.
+ */
+static void traceThread(void){
+	int flushes = 0;
+	
+	while (1){
+		if (flushes == 0)
+			traceSendNames();
+		flushes = (flushes + 1) % TRACE_NAMES_EVERY;
+		
+		traceFlush();
+		svc_r0(SYSCALL_DELAY, TRACE_FLUSH_MS);
+	}
+}
+
+void traceInit(void){
+	createKernelThread(&traceThread, "trace ", TRACE_STACK_SIZE, PRIORITY_LOWEST - 2);
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Scheduler trace
+ *
+ * With SOS_TRACE, the kernel and the interrupt handlers record events in a
+ * RAM ring: switches, ticks, SVCs and handler entry and exit, stamped with
+ * the cycle counter. A kernel thread streams the ring over the USB CDC, for
+ * tools/trace_decode.py to turn into a timeline. Without it, TRACE compiles
+ * to nothing.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <asf.h>
+#include "minios.h"
+
+//Event types
+#define TRACE_SWITCH		1	//arg: id of the incoming thread
+#define TRACE_TICK			2	//arg: low bits of the tick count
+#define TRACE_SVC			3	//arg: SVC number
+#define TRACE_ISR_ENTER		4	//arg: exception number
+#define TRACE_ISR_EXIT		5	//arg: exception number
+#define TRACE_WAKE			6	//arg: id of the thread made ready
+#define TRACE_MARK			7	//arg: any value, for marking spots in the code
+
+#ifdef SOS_TRACE
+
+//Records in the ring, a power of 2. The oldest are overwritten when the
+//stream falls behind, and counted as lost
+#define TRACE_ENTRIES		256
+
+typedef struct{
+	uint32_t cycles;		//DWT cycle count
+	uint8_t type;
+	uint8_t tid;			//running thread, 0xFF before the first switch
+	uint16_t arg;
+}TraceRecord;
+
+extern TraceRecord traceRing[TRACE_ENTRIES];
+extern volatile uint32_t traceHead;
+extern volatile int currentThreadId;
+
+/*
+ * Appends a record. Interrupts are masked for the few instructions it
+ * takes, so handlers that nest don't get the same slot.
+ */
+static inline void traceEvent(uint8_t type, uint16_t arg){
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	
+	TraceRecord* r = &traceRing[traceHead++ & (TRACE_ENTRIES - 1)];
+	r->cycles = DWT->CYCCNT;
+	r->type = type;
+	r->tid = (uint8_t) currentThreadId;
+	r->arg = arg;
+	
+	__set_PRIMASK(primask);
+}
+
+#define TRACE(type, arg) traceEvent((type), (uint16_t) (arg))
+
+void traceInit(void);
+
+#else
+
+#define TRACE(type, arg) ((void) 0)
+
+#endif
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,55 @@
+/*
+ * Work queue
+ *
+ * Work items go through a multi-producer ring, since handlers of different
+ * priorities may queue work at the same time.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#include <asf.h>
+#include "minios.h"
+#include "scheduler.h"
+#include "ring.h"
+#include "workqueue.h"
+
+#define WORK_QUEUE_SLOTS		16
+#define WORKER_STACK_SIZE		256
+
+typedef struct{
+	WorkFunction function;
+	uint32_t arg;
+	uint32_t stampMs;
+}WorkItem;
+
+MPSC_RING_DEFINE(workRing, WorkItem, WORK_QUEUE_SLOTS);
+
+/*
+ * Kernel thread that runs the queued work.
+ */
+static void workerThread(void){
+	WorkItem item;
+	
+	while (1){
+		if (ringReceive(&workRing, &item, WAIT_FOREVER) == 0)
+			item.function(item.arg, item.stampMs);
+	}
+}
+
+/*
+ * Starts the worker thread, along with the scheduler.
+ */
+void workQueueInit(void){
+	createKernelThread(&workerThread, "worker ", WORKER_STACK_SIZE, PRIORITY_HIGHEST);
+}
+
+/*
+ * Queues function to be run by the worker with arg. Meant for interrupt
+ * handlers, but works from threads too.
+ */
+bool workQueue(WorkFunction function, uint32_t arg){
+	WorkItem item = { function, arg, kernelMillis() };
+	
+	return ringSend(&workRing, &item);
+}
@@ -0,0 +1,28 @@
+/*
+ * Work queue
+ *
+ * Lets interrupt handlers defer work to a kernel thread. A handler only
+ * queues a function and an argument, stamped with the time of the event;
+ * the worker thread runs them in order at the highest priority, with
+ * interrupts enabled and free to block.
+ *
+ * Authors: Devon Harker, Josh Haskins, Vincent Tennant
+ *
+ */
+
+#ifndef WORKQUEUE_H_
+#define WORKQUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Work function, gets the argument it was queued with and the kernel time
+// in ms when it was queued
+typedef void (*WorkFunction)(uint32_t arg, uint32_t stampMs);
+
+void workQueueInit(void);
+
+// Returns false if the queue was full and the work was dropped
+bool workQueue( WorkFunction function, uint32_t arg );
+
+#endif /* WORKQUEUE_H_ */
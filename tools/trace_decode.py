@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""
+Decodes the scheduler trace that SOS streams over the USB CDC when it is
+built with SOS_TRACE (see STARTER_KIT_DEMO/src/trace.c for the format).
+
+    trace_decode.py /dev/ttyACM0             timeline of every event
+    trace_decode.py capture.bin --summary    cpu time per thread
+
+The input is read as a plain file, so a capture made with
+`cat /dev/ttyACM0 > capture.bin` works as well as the port itself (set it
+to raw mode first: `stty -F /dev/ttyACM0 raw`).
+"""
+
+import argparse
+import struct
+import sys
+
+FRAME_RECORDS = 0
+FRAME_LOST = 1
+FRAME_NAME = 2
+FRAME_CLOCK = 3
+
+NAME_LEN = 16
+RECORD = struct.Struct("<IBBH")
+
+TRACE_SWITCH = 1
+TRACE_TICK = 2
+TRACE_SVC = 3
+TRACE_ISR_ENTER = 4
+TRACE_ISR_EXIT = 5
+TRACE_WAKE = 6
+TRACE_MARK = 7
+
+EVENT_NAMES = {
+    TRACE_SWITCH: "switch",
+    TRACE_TICK: "tick",
+    TRACE_SVC: "svc",
+    TRACE_ISR_ENTER: "isr_enter",
+    TRACE_ISR_EXIT: "isr_exit",
+    TRACE_WAKE: "wake",
+    TRACE_MARK: "mark",
+}
+
+# Default until the first clock frame, the SAM4S Xplained Pro runs at 120 MHz
+DEFAULT_HZ = 120000000
+
+
+class Decoder:
+    def __init__(self):
+        self.buf = b""
+        self.hz = DEFAULT_HZ
+        self.names = {}
+        self.last_cycles = None
+        self.high = 0
+
+    def thread(self, tid):
+        if tid == 0xFF:
+            return "boot"
+        return self.names.get(tid, "tid%d" % tid)
+
+    def unwrap(self, cycles):
+        """The cycle counter wraps every 2^32 cycles, about 35 s."""
+        if self.last_cycles is not None and cycles < self.last_cycles:
+            self.high += 1 << 32
+        self.last_cycles = cycles
+        return self.high + cycles
+
+    def feed(self, data):
+        """Yields ('record', cycles, type, tid, arg) and ('lost', n)."""
+        self.buf += data
+        while True:
+            start = self.buf.find(b"TR")
+            if start < 0:
+                # keep a trailing 'T', it may start the next frame
+                self.buf = self.buf[-1:]
+                return
+            self.buf = self.buf[start:]
+            if len(self.buf) < 4:
+                return
+
+            kind, count = self.buf[2], self.buf[3]
+            if kind == FRAME_RECORDS:
+                size = 4 + count * RECORD.size
+            elif kind in (FRAME_LOST, FRAME_CLOCK):
+                size = 8
+            elif kind == FRAME_NAME:
+                size = 4 + NAME_LEN
+            else:
+                # not a frame, text on the console or noise
+                self.buf = self.buf[1:]
+                continue
+            if len(self.buf) < size:
+                return
+
+            payload, self.buf = self.buf[4:size], self.buf[size:]
+            if kind == FRAME_RECORDS:
+                for i in range(count):
+                    cycles, type_, tid, arg = RECORD.unpack_from(payload, i * RECORD.size)
+                    yield ("record", self.unwrap(cycles), type_, tid, arg)
+            elif kind == FRAME_LOST:
+                yield ("lost", struct.unpack("<I", payload)[0])
+            elif kind == FRAME_CLOCK:
+                self.hz = struct.unpack("<I", payload)[0] or DEFAULT_HZ
+            elif kind == FRAME_NAME:
+                self.names[count] = payload.split(b"\0")[0].decode("ascii", "replace").strip()
+
+
+def describe(dec, type_, arg):
+    if type_ in (TRACE_SWITCH, TRACE_WAKE):
+        return dec.thread(arg)
+    if type_ in (TRACE_ISR_ENTER, TRACE_ISR_EXIT):
+        return "irq %d" % (arg - 16) if arg >= 16 else "exception %d" % arg
+    return str(arg)
+
+
+def timeline(dec, events, out, skip_ticks):
+    start = None
+    for ev in events:
+        if ev[0] == "lost":
+            out.write("%14s  --- %d records lost ---\n" % ("", ev[1]))
+            continue
+        _, cycles, type_, tid, arg = ev
+        if skip_ticks and type_ == TRACE_TICK:
+            continue
+        if start is None:
+            start = cycles
+        us = (cycles - start) * 1e6 / dec.hz
+        out.write("%12.1f us  %-14s %-10s %s\n" % (us, dec.thread(tid),
+                  EVENT_NAMES.get(type_, "type%d" % type_), describe(dec, type_, arg)))
+
+
+def summary(dec, events, out):
+    run = {}
+    switches = {}
+    running, since = None, None
+    first = last = None
+    lost = 0
+    for ev in events:
+        if ev[0] == "lost":
+            lost += ev[1]
+            # what ran during the gap is unknown
+            running, since = None, None
+            continue
+        _, cycles, type_, tid, arg = ev
+        first = cycles if first is None else first
+        last = cycles
+        if type_ != TRACE_SWITCH:
+            continue
+        if running is not None:
+            run[running] = run.get(running, 0) + cycles - since
+        running, since = arg, cycles
+        switches[arg] = switches.get(arg, 0) + 1
+
+    if first is None:
+        out.write("no records\n")
+        return
+    if running is not None:
+        run[running] = run.get(running, 0) + last - since
+
+    total = max(last - first, 1)
+    out.write("%-14s %10s %8s %6s\n" % ("thread", "run_ms", "switches", "cpu%"))
+    for tid in sorted(run, key=run.get, reverse=True):
+        out.write("%-14s %10.2f %8d %5.1f%%\n" % (dec.thread(tid), run[tid] * 1e3 / dec.hz,
+                  switches.get(tid, 0), 100.0 * run[tid] / total))
+    out.write("%.2f ms traced, %d records lost\n" % (total * 1e3 / dec.hz, lost))
+
+
+def read_events(dec, stream):
+    while True:
+        data = stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+        if not data:
+            return
+        yield from dec.feed(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="serial port or capture file, - for stdin")
+    parser.add_argument("--summary", action="store_true", help="cpu time per thread instead of the timeline")
+    parser.add_argument("--ticks", action="store_true", help="show tick events in the timeline")
+    args = parser.parse_args()
+
+    stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb", buffering=0)
+    dec = Decoder()
+    try:
+        if args.summary:
+            summary(dec, read_events(dec, stream), sys.stdout)
+        else:
+            timeline(dec, read_events(dec, stream), sys.stdout, not args.ticks)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()